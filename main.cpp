@@ -1,10 +1,141 @@
+#include <iterator>
+
 #include <QApplication>
+#include <QElapsedTimer>
 #include <QTimer>
 
 #include "myobject.h"
+#include "qcosignal_virtualtime.hpp"
+
+#ifdef COSIGNAL_METRICS
+static void printMetrics()
+{
+    const CoroutineMetrics::Snapshot metrics = CoroutineMetrics::snapshot();
+
+    qDebug() << "coroutines created:" << metrics.created << "completed:" << metrics.completed
+             << "aborted (owner / sender / unwound / other):"
+             << metrics.aborted[int(AbortReason::OwnerDestroyed)]
+             << metrics.aborted[int(AbortReason::SenderDestroyed)]
+             << metrics.aborted[int(AbortReason::Unwound)]
+             << metrics.aborted[int(AbortReason::Other)];
+
+    auto print = [](const char *name, const LatencyHistogram &histogram) {
+        qDebug() << name << "count" << histogram.count
+                 << "p50" << histogram.percentile(0.5) / 1000 << "us"
+                 << "p99" << histogram.percentile(0.99) / 1000 << "us"
+                 << "max" << histogram.max / 1000 << "us";
+    };
+    print("signal -> resume", metrics.signalLatency);
+    print("future -> resume", metrics.futureLatency);
+    print("frame lifetime", metrics.frameLifetime);
+
+    const char *kinds[] = {
+        "suspended on signal", "suspended on anyOf", "suspended on future", "suspended on coroutine",
+        "suspended on generator", "suspended on I/O", "suspended on process", "suspended on job", "suspended on other",
+    };
+    for (int kind = 0; kind < int(AwaitKind::Count); ++kind) {
+        if (metrics.suspension[kind].count) {
+            print(kinds[kind], metrics.suspension[kind]);
+        }
+    }
+}
+#endif
+
+/*
+ * scenarios relying only on timers, signals and futures — these run in virtual time
+ */
+static Async<>(MyObject::*const virtualTimeTests[])(void) = {
+    &MyObject::testAwaitSignal1,
+    &MyObject::testAwaitSignal2,
+    &MyObject::testAwaitSignal3,
+    &MyObject::testAwaitFutureWithResult,
+    &MyObject::testAwaitFutureWithoutResult,
+    &MyObject::testCoSignalModes,
+    &MyObject::testAnyOf,
+    &MyObject::testAnyOfSendersDestroyed,
+    &MyObject::testTryAwaitFuture,
+    &MyObject::testTryAwaitSenderDestroyed,
+    &MyObject::testSharedAsync,
+    &MyObject::testYieldToEventLoop,
+    &MyObject::testYieldFanOut,
+    &MyObject::testSpawnCoroViaSignal,
+    &MyObject::testAwaitCoro,
+    &MyObject::testAwaitSignalOwnerDestroyed,
+    &MyObject::testAwaitSignalSenderDestroyed,
+    &MyObject::testAwaitFutureOwnerDestroyed,
+    &MyObject::testAwaitFutureFailed,
+    &MyObject::testAwaitCoroUpstackDestroyed,
+    &MyObject::testAwaitCoroDownstackDestroyed,
+    &MyObject::testAwaitCoroMidstackDestroyed,
+    &MyObject::testShootInMyFingFootAndMiss,
+    &MyObject::testShootInMyFingFootAndMiss2,
+    &MyObject::testAsyncGenerator,
+    &MyObject::testAsyncGeneratorAbandoned,
+    &MyObject::testAsyncGeneratorOwnerDestroyed,
+    &MyObject::testAsyncGeneratorOwnerDestroyedBetweenNext,
+};
+
+/*
+ * scenarios report what should never happen (e.g. reaching "unreachable!") with qCritical()
+ */
+static int criticalMessages = 0;
+static QtMessageHandler defaultMessageHandler = nullptr;
+
+static void countCriticalMessages(QtMsgType type, const QMessageLogContext &context, const QString &message)
+{
+    if (type == QtCriticalMsg) {
+        ++criticalMessages;
+    }
+    defaultMessageHandler(type, context, message);
+}
+
+/*
+ * `qcosignal --virtual-time [seed] [runs]` — runs them `runs` times, each with the next seed
+ *
+ * stops at the first scenario which reported something critical or left coroutines behind,
+ * printing its' seed, so it can be rerun (and debugged) with exactly the same interleaving
+ */
+static int runInVirtualTime(int &argc, char **argv, quint32 seed, int runs)
+{
+    defaultMessageHandler = qInstallMessageHandler(&countCriticalMessages);
+
+    // must be set before application is created
+    VirtualTimeDispatcher *dispatcher = new VirtualTimeDispatcher(seed);
+    QCoreApplication::setEventDispatcher(dispatcher);
+    QCoreApplication app(argc, argv);
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int run = 0; run < runs; ++run) {
+        qDebug() << "################################################################################### seed" << seed + run;
+        dispatcher->reseed(seed + run);
+        for (int test = 0; test < int(std::size(virtualTimeTests)); ++test) {
+            const int criticalBefore = criticalMessages;
+            MyObject::runTest(virtualTimeTests[test]);
+
+            const int alive = MyObject::aliveCoroutines();
+            if (criticalMessages != criticalBefore || alive != 0) {
+                qWarning() << "scenario" << test << "failed with seed" << seed + run << ":"
+                           << criticalMessages - criticalBefore << "critical messages,"
+                           << alive << "coroutines left alive"
+                           << "(rerun with `--virtual-time" << seed + run << "1`)";
+                return 1;
+            }
+        }
+    }
+    qDebug() << runs << "runs took" << timer.elapsed() << "ms of real time and" << dispatcher->now() << "ms of virtual time";
+
+    return 0;
+}
 
 int main(int argc, char **argv)
 {
+    if (argc > 1 && qstrcmp(argv[1], "--virtual-time") == 0) {
+        const quint32 seed = argc > 2 ? QByteArray(argv[2]).toUInt() : 1;
+        const int runs = argc > 3 ? QByteArray(argv[3]).toInt() : 1;
+        return runInVirtualTime(argc, argv, seed, runs);
+    }
+
     QApplication app(argc, argv);
 
     QTimer t;
@@ -17,11 +148,26 @@ int main(int argc, char **argv)
     MyObject::runTest(&MyObject::testAwaitSignal3);
     MyObject::runTest(&MyObject::testAwaitFutureWithResult);
     MyObject::runTest(&MyObject::testAwaitFutureWithoutResult);
+    MyObject::runTest(&MyObject::testCoSignalModes);
+    MyObject::runTest(&MyObject::testCoSignalCrossThread);
+    MyObject::runTest(&MyObject::testAnyOf);
+    MyObject::runTest(&MyObject::testAnyOfSendersDestroyed);
+    MyObject::runTest(&MyObject::testTryAwaitFuture);
+    MyObject::runTest(&MyObject::testTryAwaitSenderDestroyed);
+    MyObject::runTest(&MyObject::testSharedAsync);
+    MyObject::runTest(&MyObject::testAsyncCache);
+    MyObject::runTest(&MyObject::testYieldToEventLoop);
+    MyObject::runTest(&MyObject::testYieldFanOut);
+    MyObject::runTest(&MyObject::testMoveToThread);
+    MyObject::runTest(&MyObject::testMoveToThreadAndDestroy);
+    MyObject::runTest(&MyObject::testThreadExitWithFileReadInFlight);
     MyObject::runTest(&MyObject::testSpawnCoroViaSignal);
     MyObject::runTest(&MyObject::testAwaitCoro);
+    MyObject::runTest(&MyObject::benchReadyPath);
     MyObject::runTest(&MyObject::testAwaitSignalOwnerDestroyed);
     MyObject::runTest(&MyObject::testAwaitSignalSenderDestroyed);
     MyObject::runTest(&MyObject::testAwaitFutureOwnerDestroyed);
+    MyObject::runTest(&MyObject::testAwaitFutureFailed);
 
     MyObject::runTest(&MyObject::testAwaitCoroUpstackDestroyed);
     MyObject::runTest(&MyObject::testAwaitCoroDownstackDestroyed);
@@ -30,8 +176,32 @@ int main(int argc, char **argv)
     MyObject::runTest(&MyObject::testShootInMyFingFootAndMiss);
     MyObject::runTest(&MyObject::testShootInMyFingFootAndMiss2);
 
+    MyObject::runTest(&MyObject::testAwaitIODevice);
+    MyObject::runTest(&MyObject::benchIODeviceThroughput);
+
+    MyObject::runTest(&MyObject::testRunProcess);
+    MyObject::runTest(&MyObject::testProcessStream);
+    MyObject::runTest(&MyObject::testProcessOwnerDestroyed);
+
+    MyObject::runTest(&MyObject::testAwaitFileIO);
+
+    MyObject::runTest(&MyObject::testFdReadiness);
+    MyObject::runTest(&MyObject::benchFdPingPong);
+
+    MyObject::runTest(&MyObject::testAsyncGenerator);
+    MyObject::runTest(&MyObject::testAsyncGeneratorAbandoned);
+    MyObject::runTest(&MyObject::testAsyncGeneratorOwnerDestroyed);
+    MyObject::runTest(&MyObject::testAsyncGeneratorOwnerDestroyedBetweenNext);
+
+    MyObject::runTest(&MyObject::benchJobScaling);
+    MyObject::runTest(&MyObject::testJobOwnerDestroyed);
+
     MyObject::runTest(&MyObject::demonstrationWhyIEvenBothered);
 
+#ifdef COSIGNAL_METRICS
+    printMetrics();
+#endif
+
     MyObject::runTest(&MyObject::testShootInMyFingFootAndHit);
 
     return 0;
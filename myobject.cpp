@@ -1,5 +1,10 @@
 #include "myobject.h"
 
+#include <algorithm>
+#include <atomic>
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <QApplication>
 #include <QtConcurrent>
 #include <QDebug>
@@ -9,29 +14,42 @@
 #include <QHBoxLayout>
 #include <QPushButton>
 #include <QLabel>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QElapsedTimer>
+#include <QTemporaryFile>
 
 #include "qcosignal.hpp"
+#include "qcosignal_io.hpp"
+#include "qcosignal_job.hpp"
+#include "qcosignal_cache.hpp"
+#include "qcosignal_virtualtime.hpp"
 
 struct Marker
 {
     Marker(QString tag)
         : tag(tag)
     {
+        ++alive;
         qDebug() << "Created:" << tag;
     }
 
     ~Marker()
     {
+        --alive;
         qDebug() << "Destroyed:" << tag;
     }
 
     QString tag;
+
+    // coroutines of scenarios, which haven't finished (or been aborted) yet
+    static inline int alive = 0;
 };
 
 QString concurrent_with_result(int seconds)
 {
     qDebug() << __PRETTY_FUNCTION__ << "sleeping for" << seconds << "seconds";
-    QThread::sleep(seconds);
+    VirtualTime::sleep(std::chrono::seconds(seconds));
     qDebug() << __PRETTY_FUNCTION__ << "sleeping done";
     return QString("slept for %1 seconds").arg(seconds);
 }
@@ -39,10 +57,48 @@ QString concurrent_with_result(int seconds)
 void concurrent_without_result(int seconds)
 {
     qDebug() << __PRETTY_FUNCTION__ << "sleeping for" << seconds << "seconds";
-    QThread::sleep(seconds);
+    VirtualTime::sleep(std::chrono::seconds(seconds));
     qDebug() << __PRETTY_FUNCTION__ << "sleeping done";
 }
 
+// loads "slept for N seconds" for key N, counting loads
+auto counting_loader(int *loads)
+{
+    return [loads] (int seconds) {
+        ++*loads;
+        return VirtualTime::run(&concurrent_with_result, seconds);
+    };
+}
+
+// baseline for the ready path of Async<int>, kept out of line just as coroutine's ramp
+Q_NEVER_INLINE int plain_value(int x)
+{
+    return x + 1;
+}
+
+// leaves computed by fib() so far, to tell whether canceled job graph stopped
+std::atomic<qint64> fib_leaves = 0;
+
+qint64 serial_fib(int n)
+{
+    return n < 2 ? n : serial_fib(n - 1) + serial_fib(n - 2);
+}
+
+/*
+ * forks two jobs per level, leaves are big enough to outweigh scheduling
+ */
+Job<qint64> fib(JobExecutor &executor, int n)
+{
+    if (n < 20) {
+        fib_leaves.fetch_add(1, std::memory_order_relaxed);
+        co_return serial_fib(n);
+    }
+
+    Job<qint64> left = fib(executor, n - 1);
+    Job<qint64> right = fib(executor, n - 2);
+    co_return co_await left + co_await right;
+}
+
 void MyObject::runTest(Async<>(MyObject::*testFunction)(void))
 {
     qDebug() << "===================================================================================";
@@ -55,6 +111,11 @@ void MyObject::runTest(Async<>(MyObject::*testFunction)(void))
     }
 }
 
+int MyObject::aliveCoroutines()
+{
+    return Marker::alive;
+}
+
 MyObject::MyObject(QString name)
 {
     setObjectName(name);
@@ -71,7 +132,7 @@ Async<> MyObject::demonstrationWhyIEvenBothered()
     QMessageBox::ButtonRole role = co_await messageBox("Do the deed?");
     if (role == QMessageBox::AcceptRole) {
         qDebug() << "running concurrent task";
-        QString result = co_await QtConcurrent::run(&concurrent_with_result, 3);
+        QString result = co_await VirtualTime::run(&concurrent_with_result, 3);
         qDebug() << "concurrent task result:" << result;
     } else if (role == QMessageBox::RejectRole) {
         qDebug() << "suit yourself";
@@ -140,7 +201,7 @@ Async<> MyObject::testAwaitFutureWithResult()
 
     qDebug() << "awaiting concurrent future";
 
-    QString result = co_await QtConcurrent::run(&concurrent_with_result, 1);
+    QString result = co_await VirtualTime::run(&concurrent_with_result, 1);
 
     qDebug() << "concurrent future result:" << result;
 }
@@ -151,11 +212,424 @@ Async<> MyObject::testAwaitFutureWithoutResult()
 
     qDebug() << "awaiting concurrent future";
 
-    co_await QtConcurrent::run(&concurrent_without_result, 1);
+    co_await VirtualTime::run(&concurrent_without_result, 1);
 
     qDebug() << "concurrent future done";
 }
 
+Async<> MyObject::testCoSignalModes()
+{
+    Marker m(__PRETTY_FUNCTION__);
+
+    MyObject sender("sender");
+
+    auto burst = [&] {
+        for (int i = 1; i <= 1000; ++i) {
+            emit sender.signal1(i);
+        }
+    };
+
+    {
+        CoSignal coalesced(&sender, &MyObject::signal1, CoSignalFlags::Coalesce);
+        QTimer::singleShot(0, burst);
+        auto [latest] = co_await coalesced;
+        qDebug() << "coalesced 1000 emissions, latest:" << latest;
+    }
+
+    {
+        CoSignal batched(&sender, &MyObject::signal1, CoSignalFlags::Coalesce | CoSignalFlags::Batch);
+        // whole burst fits, so emissions don't allocate
+        batched.reserveBatch(1000);
+        QTimer::singleShot(0, burst);
+        co_await batched;
+        qDebug() << "batched" << batched.batch().size() << "emissions, first:" << std::get<0>(batched.batch().front());
+    }
+
+    int ticks = 0;
+    QTimer ticker;
+    ticker.setInterval(1);
+    ticker.callOnTimeout([&] { emit sender.signal1(++ticks); });
+    ticker.start();
+
+    {
+        CoSignal throttled(&sender, &MyObject::signal1, CoSignalFlags::Throttle, 50);
+        for (int i = 0; i < 5; ++i) {
+            auto [tick] = co_await throttled;
+            qDebug() << "throttled, tick:" << tick;
+        }
+    }
+
+    {
+        QTimer::singleShot(200, &ticker, &QTimer::stop);
+        CoSignal debounced(&sender, &MyObject::signal1, CoSignalFlags::Debounce, 50);
+        auto [last] = co_await debounced;
+        qDebug() << "debounced after ticker stopped, last tick:" << last << "of" << ticks;
+    }
+}
+
+Async<> MyObject::testCoSignalCrossThread()
+{
+    Marker m(__PRETTY_FUNCTION__);
+
+    QThread thread;
+    MyObject *producer = new MyObject("producer");
+    producer->moveToThread(&thread);
+    connect(&thread, &QThread::finished, producer, &QObject::deleteLater);
+    thread.start();
+
+    // producer emits payloads every 100ms in its' own thread
+    QMetaObject::invokeMethod(producer, [producer] {
+        QTimer *ticker = new QTimer(producer);
+        ticker->callOnTimeout([producer, i = 0] () mutable {
+            emit producer->payload(TrackedPayload(QByteArray(64 * 1024, char('a' + i++ % 26))));
+        });
+        ticker->start(100);
+    });
+
+    {
+        CoSignal payloads(producer, &MyObject::payload, CoSignalFlags::CrossThread);
+
+        for (int i = 0; i < 3; ++i) {
+            // slot keeps only the latest emission, older ones are dropped if we're too slow
+            auto [data] = co_await payloads;
+            qDebug() << "received" << data.bytes.size() << "bytes of" << data.bytes.at(0);
+
+            // copied once into the slot right in emitting thread, only moved after that
+            if (data.copies != 1 || data.copiedIn != &thread) {
+                qCritical() << __PRETTY_FUNCTION__ << "payload copied" << data.copies << "times, last one in"
+                            << data.copiedIn << "instead of once in" << &thread;
+            }
+        }
+    }
+
+    thread.quit();
+    thread.wait();
+}
+
+Async<> MyObject::testAnyOf()
+{
+    Marker m(__PRETTY_FUNCTION__);
+
+    MyObject a("a");
+    MyObject b("b");
+
+    qDebug() << "setting emit timers, signal2 of b goes first";
+    QTimer::singleShot(300, &b, [&] { emit b.signal2(2, "two"); });
+    QTimer::singleShot(600, &a, [&] { emit a.signal1(1); });
+
+    auto result = co_await anyOf(
+        CoSignal(&a, &MyObject::signal1),
+        CoSignal(&b, &MyObject::signal2),
+        CoSignal(&a, &MyObject::signal3)
+    );
+
+    if (result.index() == 1) {
+        auto [arg1, arg2] = std::get<1>(result);
+        qDebug() << "signal2 of b won:" << arg1 << arg2;
+    } else {
+        qCritical() << __PRETTY_FUNCTION__ << "wrong signal won:" << result.index();
+    }
+
+    qDebug() << "awaiting signal1 of a, lost connections should be gone by now";
+    auto [arg] = co_await CoSignal(&a, &MyObject::signal1);
+    qDebug() << "signal1 received:" << arg;
+}
+
+Async<> MyObject::testAnyOfSendersDestroyed()
+{
+    Marker m(__PRETTY_FUNCTION__);
+
+    MyObject *a = new MyObject("a");
+    MyObject *b = new MyObject("b");
+    QTimer::singleShot(100, a, &QObject::deleteLater);
+    QTimer::singleShot(200, b, &QObject::deleteLater);
+
+    co_await anyOf(
+        CoSignal(a, &MyObject::signal1),
+        CoSignal(b, &MyObject::signal3)
+    );
+
+    qCritical() << __PRETTY_FUNCTION__ << "unreachable!";
+}
+
+Async<> MyObject::testTryAwaitFuture()
+{
+    Marker m(__PRETTY_FUNCTION__);
+
+    QTimer::singleShot(100, this, &MyObject::setPromiseResult);
+    Expected<int> result = co_await doubled(m_promise.future());
+    qDebug() << "doubled future result:" << *result;
+
+    QPromise<int> abandoned;
+    abandoned.start();
+    QTimer::singleShot(100, this, [&abandoned] {
+        abandoned.future().cancel();
+        abandoned.finish();
+    });
+
+    result = co_await doubled(abandoned.future());
+    if (!result) {
+        qDebug() << "canceled future returned error" << int(result.error()) << "instead of aborting";
+    }
+}
+
+Async<> MyObject::testTryAwaitSenderDestroyed()
+{
+    Marker m(__PRETTY_FUNCTION__);
+
+    MyObject *sender = new MyObject("sender");
+    QTimer::singleShot(100, sender, [sender] { emit sender->signal1(1); });
+    QTimer::singleShot(150, sender, [sender] { emit sender->signal1(2); });
+    QTimer::singleShot(200, sender, &QObject::deleteLater);
+
+    CoSignal numbers(sender, &MyObject::signal1, CoSignalFlags(0));
+    while (Expected<std::tuple<int>> args = co_await tryAwait(numbers)) {
+        qDebug() << "signal arg:" << std::get<0>(*args);
+    }
+    qDebug() << "sender destroyed, coroutine goes on";
+
+    MyObject *a = new MyObject("a");
+    MyObject *b = new MyObject("b");
+    QTimer::singleShot(100, a, &QObject::deleteLater);
+    QTimer::singleShot(200, b, &QObject::deleteLater);
+
+    auto any = co_await tryAwait(anyOf(
+        CoSignal(a, &MyObject::signal1),
+        CoSignal(b, &MyObject::signal3)
+    ));
+    if (!any && any.error() == AwaitError::SenderDestroyed) {
+        qDebug() << "all senders destroyed, coroutine goes on";
+    }
+}
+
+Async<> MyObject::testSharedAsync()
+{
+    Marker m(__PRETTY_FUNCTION__);
+
+    int resumed = 0;
+    SharedAsync<int> shared = coroSleep(1);
+    for (int i = 0; i < 200; ++i) {
+        awaitShared(shared, &resumed);
+    }
+
+    // losing one of the waiters doesn't affect the rest
+    MyObject *quitter = new MyObject("quitter");
+    quitter->awaitShared(shared, &resumed);
+    QTimer::singleShot(100, quitter, &QObject::deleteLater);
+
+    const int &result = co_await shared;
+    qDebug() << "shared result:" << result << "computed once for" << resumed << "waiters";
+
+    // losing the last one aborts shared coroutine itself
+    MyObject *lonely = new MyObject("lonely");
+    SharedAsync<int> abandoned = coroSleep(1);
+    lonely->awaitShared(abandoned, &resumed);
+    QTimer::singleShot(100, lonely, &QObject::deleteLater);
+
+    co_await VirtualTime::run(&concurrent_without_result, 1);
+    qDebug() << "abandoned shared coroutine is" << (abandoned.m_state->current ? "still running" : "aborted");
+}
+
+Async<> MyObject::testAsyncCache()
+{
+    Marker m(__PRETTY_FUNCTION__);
+
+    int loads = 0;
+    AsyncCache<int, QString> cache(this, 2, std::chrono::milliseconds(2500));
+
+    for (int i = 0; i < 10; ++i) {
+        awaitCached(&cache, 1, &loads);
+    }
+    QString value = co_await cache.get(1, counting_loader(&loads));
+    qDebug() << "11 concurrent gets of the same key:" << value << "loads:" << loads;
+
+    value = co_await cache.get(1, counting_loader(&loads));
+    co_await cache.get(2, counting_loader(&loads));
+    co_await cache.get(3, counting_loader(&loads));
+    qDebug() << "cached get, then two more keys — loads:" << loads << "least recently used key evicted:" << !cache.contains(1);
+
+    co_await VirtualTime::run(&concurrent_without_result, 3);
+    co_await cache.get(3, counting_loader(&loads));
+    qDebug() << "get after TTL has passed — loads:" << loads;
+
+    MyObject *impatient = new MyObject("impatient");
+    impatient->awaitCached(&cache, 4, &loads);
+    QTimer::singleShot(100, impatient, &QObject::deleteLater);
+    co_await VirtualTime::run(&concurrent_without_result, 1);
+
+    value = co_await cache.get(4, counting_loader(&loads));
+    qDebug() << "get after aborted load:" << value << "loads:" << loads;
+}
+
+Async<> MyObject::testYieldToEventLoop()
+{
+    Marker m(__PRETTY_FUNCTION__);
+
+    QMetaObject::invokeMethod(this, [] { qDebug() << "pending event processed"; }, Qt::QueuedConnection);
+    co_await yieldNow();
+    qDebug() << "resumed after pending events";
+
+    int ticks = 0;
+    qint64 longestGap = 0;
+    QElapsedTimer sinceTick;
+    sinceTick.start();
+    QTimer ticker;
+    ticker.setInterval(5);
+    ticker.callOnTimeout([&] {
+        ++ticks;
+        longestGap = qMax(longestGap, sinceTick.restart());
+    });
+    ticker.start();
+
+    // ~1.5 s of CPU work right in this thread, without starving the event loop
+    // (virtual time doesn't move while coroutine keeps yielding, so there a short one is enough)
+    const qint64 busy = VirtualTime::enabled() ? 50 : 1500;
+    QElapsedTimer timer;
+    timer.start();
+    qint64 sum = 0;
+    for (int i = 0; timer.elapsed() < busy; ++i) {
+        sum += serial_fib(15 + i % 5);
+        co_await yieldIfNeeded(std::chrono::milliseconds(16));
+    }
+    qDebug() << "busy loop done, sum:" << sum << "timer ticks meanwhile:" << ticks
+             << "longest gap between ticks:" << longestGap << "ms";
+}
+
+Async<> MyObject::testYieldFanOut()
+{
+    Marker m(__PRETTY_FUNCTION__);
+
+    // all of them are resumed by the same pass, whichever of the rest comes first destroys owner of the last one
+    // (which is either resumed before that or aborted)
+    QList<int> order;
+    MyObject *doomed = new MyObject("doomed");
+    for (int id = 0; id < 8; ++id) {
+        awaitYieldInOrder(id, &order, &doomed);
+    }
+    doomed->awaitYieldInOrder(8, &order, &doomed);
+
+    while (order.size() < 8 || doomed) {
+        co_await yieldNow();
+    }
+    qDebug() << "yielded coroutines resumed in order:" << order;
+
+    QList<int> sorted = order;
+    std::sort(sorted.begin(), sorted.end());
+    if (sorted.size() > 9 || std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end()
+            || (order.size() == 9 && order.first() != 8)) {
+        qCritical() << __PRETTY_FUNCTION__ << "wrong resumes:" << order;
+    }
+}
+
+Async<> MyObject::testMoveToThread()
+{
+    Marker m(__PRETTY_FUNCTION__);
+
+    QThread worker;
+    worker.start();
+
+    QTemporaryFile file;
+    file.open();
+    file.write(QByteArray(4096, 'a'));
+    file.flush();
+
+    MyObject *service = new MyObject("service");
+    connect(&worker, &QThread::finished, service, &QObject::deleteLater);
+
+    // each one is suspended on its' own kind of wake-up
+    service->awaitDebounced();
+    service->awaitYield();
+    service->awaitFuture();
+    service->awaitFileRead(file.fileName());
+    // debounce timer is ticking already
+    emit service->signal1(1);
+
+    service->moveToThread(&worker);
+    qDebug() << "service moved to worker thread with four coroutines suspended";
+
+    co_await VirtualTime::run(&concurrent_without_result, 2);
+
+    worker.quit();
+    worker.wait();
+}
+
+Async<> MyObject::testMoveToThreadAndDestroy()
+{
+    Marker m(__PRETTY_FUNCTION__);
+
+    QThread worker;
+    worker.start();
+
+    QTemporaryFile file;
+    file.open();
+    file.write(QByteArray(4096, 'a'));
+    file.flush();
+
+    int fds[2];
+    if (::pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0) {
+        qDebug() << "pipe2() failed:" << errno;
+        co_return;
+    }
+
+    MyObject *service = new MyObject("service");
+
+    // waiting in this thread's yield and file I/O queues, and on its' fd notifier (which is never written to)
+    QList<int> order;
+    service->awaitYield();
+    service->awaitFileRead(file.fileName());
+    service->awaitReadable(fds[0], 0, &order);
+
+    service->moveToThread(&worker);
+    // destroyed in the worker, while this thread may be waking its' coroutines up at the very same moment
+    service->deleteLater();
+    qDebug() << "service moved to worker thread and is being destroyed there with three coroutines suspended";
+
+    co_await VirtualTime::run(&concurrent_without_result, 1);
+
+    worker.quit();
+    worker.wait();
+
+    if (!order.isEmpty()) {
+        qCritical() << __PRETTY_FUNCTION__ << "fd waiter resumed without fd being readable";
+    }
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+Async<> MyObject::testThreadExitWithFileReadInFlight()
+{
+    Marker m(__PRETTY_FUNCTION__);
+
+    QThread worker;
+    worker.start();
+
+    QTemporaryFile file;
+    file.open();
+    file.write(QByteArray(4096, 'a'));
+    file.flush();
+
+    MyObject *service = new MyObject("service");
+    service->moveToThread(&worker);
+
+    bool resumed = false;
+    QThread *home = thread();
+    QMetaObject::invokeMethod(service, [service, home, path = file.fileName(), &resumed] {
+        // read goes into worker's file I/O queue, which is gone right after owner goes back home
+        service->awaitFileRead(path, &resumed);
+        service->moveToThread(home);
+        QThread::currentThread()->quit();
+    });
+    worker.wait();
+    qDebug() << "worker thread exited with file read in flight";
+
+    // resume is posted to the service
+    co_await VirtualTime::run(&concurrent_without_result, 0);
+    if (!resumed) {
+        qCritical() << __PRETTY_FUNCTION__ << "file read was lost along with worker thread";
+    }
+    delete service;
+}
+
 Async<> MyObject::testSpawnCoroViaSignal()
 {
     Marker m(__PRETTY_FUNCTION__);
@@ -186,6 +660,32 @@ Async<> MyObject::testAwaitCoro()
     qDebug() << "sub-coroutine result:" << result;
 }
 
+Async<> MyObject::benchReadyPath()
+{
+    Marker m(__PRETTY_FUNCTION__);
+
+    const int calls = 1000000;
+    qint64 sum = 0;
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < calls; ++i) {
+        sum += plain_value(i);
+    }
+    const qint64 plain = timer.nsecsElapsed();
+
+    // never suspends: pooled frame and state, no connection to the owner
+    timer.restart();
+    for (int i = 0; i < calls; ++i) {
+        sum += co_await readyValue(i);
+    }
+    const qint64 ready = timer.nsecsElapsed();
+
+    qDebug() << calls << "calls: plain function" << double(plain) / calls << "ns per call,"
+             << "ready Async<int>" << double(ready) / calls << "ns per call"
+             << "(checksum" << sum << ")";
+}
+
 Async<> MyObject::testAwaitSignalOwnerDestroyed()
 {
     Marker m(__PRETTY_FUNCTION__);
@@ -230,7 +730,7 @@ Async<> MyObject::testAwaitFutureOwnerDestroyed()
 
     qDebug() << "awaiting concurrent";
 
-    co_await QtConcurrent::run(&concurrent_without_result, 1);
+    co_await VirtualTime::run(&concurrent_without_result, 1);
 
     qCritical() << __PRETTY_FUNCTION__ << "unreachable!";
 }
@@ -245,9 +745,10 @@ Async<> MyObject::testAwaitFutureFailed()
 
     qDebug() << "awaiting future from promise";
 
+    // failed future aborts coroutine, instead of leaving it hanging until owner is destroyed
     int result = co_await m_promise.future();
 
-    qDebug() << "future result:" << result;
+    qCritical() << __PRETTY_FUNCTION__ << "unreachable!" << result;
 }
 
 Async<> MyObject::testAwaitCoroUpstackDestroyed()
@@ -308,7 +809,7 @@ Async<> MyObject::testShootInMyFingFootAndMiss()
 
     QTimer::singleShot(500, [=] { delete that; });
 
-    co_await QtConcurrent::run(&concurrent_without_result, 1);
+    co_await VirtualTime::run(&concurrent_without_result, 1);
     qDebug() << "still in" << __PRETTY_FUNCTION__;
 }
 
@@ -318,7 +819,7 @@ Async<> MyObject::testShootInMyFingFootAndMiss2()
 
     deleteLater();
 
-    co_await QtConcurrent::run(&concurrent_without_result, 1);
+    co_await VirtualTime::run(&concurrent_without_result, 1);
     qDebug() << "still in" << __PRETTY_FUNCTION__;
 }
 
@@ -328,17 +829,357 @@ Async<> MyObject::testShootInMyFingFootAndHit()
 
     MyObject *that = this;
 
-    co_await QtConcurrent::run(&concurrent_without_result, 1);
+    co_await VirtualTime::run(&concurrent_without_result, 1);
     qDebug() << "back in" << __PRETTY_FUNCTION__;
     // emitting some signal that calls some sync function that results in:
     delete that;
     qDebug() << "still in" << __PRETTY_FUNCTION__;
 }
 
+Async<> MyObject::testAwaitIODevice()
+{
+    Marker m(__PRETTY_FUNCTION__);
+
+    QLocalServer server;
+    QLocalServer::removeServer("qcosignal-test");
+    server.listen("qcosignal-test");
+
+    QLocalSocket client;
+    client.connectToServer("qcosignal-test");
+
+    qDebug() << "awaiting connection";
+    co_await CoSignal(&server, &QLocalServer::newConnection);
+    QLocalSocket *peer = server.nextPendingConnection();
+
+    qint64 written = co_await writeAll(&client, "first line\nsecond line\n12345");
+    qDebug() << "bytes written:" << written;
+
+    PooledBuffer line = co_await readLine(peer);
+    qDebug() << "line received:" << line.toByteArray();
+
+    line = co_await readLine(peer);
+    qDebug() << "line received:" << line.toByteArray();
+
+    PooledBuffer tail = co_await readExactly(peer, 5);
+    qDebug() << "exactly 5 bytes received:" << tail.toByteArray();
+
+    qDebug() << "closing client while awaiting";
+    QTimer::singleShot(100, &client, [&] { client.close(); });
+    PooledBuffer rest = co_await readExactly(peer, 1000);
+    qDebug() << "short read after close:" << rest.size();
+}
+
+Async<> MyObject::benchIODeviceThroughput()
+{
+    Marker m(__PRETTY_FUNCTION__);
+
+    constexpr qint64 total = 256 * 1024 * 1024;
+    constexpr qint64 chunk = 64 * 1024;
+
+    QLocalServer server;
+    QLocalServer::removeServer("qcosignal-bench");
+    server.listen("qcosignal-bench");
+
+    QLocalSocket client;
+    client.connectToServer("qcosignal-bench");
+
+    co_await CoSignal(&server, &QLocalServer::newConnection);
+    QLocalSocket *peer = server.nextPendingConnection();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    Async<> writer = pump(&client, total, chunk);
+
+    qint64 received = 0;
+    while (received < total) {
+        PooledBuffer buffer = co_await readSome(peer, chunk);
+        if (buffer.isEmpty()) {
+            break;
+        }
+        received += buffer.size();
+    }
+
+    co_await writer;
+
+    double seconds = timer.nsecsElapsed() / 1e9;
+    qDebug() << "received" << received << "bytes in" << seconds << "s:"
+             << (received / (1024.0 * 1024.0)) / seconds << "MiB/s";
+}
+
+Async<> MyObject::testRunProcess()
+{
+    Marker m(__PRETTY_FUNCTION__);
+
+    qDebug() << "awaiting process";
+
+    ProcessResult result = co_await runProcess("sh", {"-c", "echo out; echo err >&2; exit 3"});
+
+    qDebug() << "process finished:" << result.exitCode << result.standardOutput << result.standardError;
+
+    result = co_await runProcess("/nonexistent/program");
+
+    qDebug() << "nonexistent program started:" << result.started;
+}
+
+Async<> MyObject::testProcessStream()
+{
+    Marker m(__PRETTY_FUNCTION__);
+
+    ProcessStream process("sh", {"-c", "for i in 1 2 3; do echo $i; echo e$i >&2; sleep 0.2; done; exit 7"});
+
+    while (std::optional<ProcessChunk> chunk = co_await process.next()) {
+        qDebug() << "chunk from" << chunk->channel << chunk->data.toByteArray();
+    }
+
+    qDebug() << "process stream finished:" << process.exitCode();
+}
+
+Async<> MyObject::testProcessOwnerDestroyed()
+{
+    Marker m(__PRETTY_FUNCTION__);
+
+    QTimer::singleShot(100, this, [this] { deleteLater(); });
+
+    qDebug() << "awaiting long process";
+
+    co_await runProcess("sleep", {"10"});
+
+    qCritical() << __PRETTY_FUNCTION__ << "unreachable!";
+}
+
+Async<> MyObject::testAwaitFileIO()
+{
+    Marker m(__PRETTY_FUNCTION__);
+
+    qDebug() << "using io_uring:" << FileIOQueue::local().usesUring();
+
+    QTemporaryFile file;
+    file.open();
+    int fd = file.handle();
+
+    qint64 written = co_await writeAt(fd, 0, QByteArray(100000, 'a'));
+    qDebug() << "written:" << written;
+
+    written = co_await writeAt(fd, 100000, "tail");
+    qDebug() << "written:" << written;
+
+    PooledBuffer head = co_await readAt(fd, 0, 10);
+    qDebug() << "read at 0:" << head.toByteArray();
+
+    PooledBuffer tail = co_await readAt(fd, 99998, 100);
+    qDebug() << "read at 99998:" << tail.toByteArray();
+
+    Expected<PooledBuffer, int> whole = co_await readFile(file.fileName());
+    qDebug() << "whole file size:" << (whole ? whole->size() : -1);
+
+#ifdef Q_OS_LINUX
+    // reports zero size, but isn't empty
+    Expected<PooledBuffer, int> status = co_await readFile("/proc/self/status");
+    qDebug() << "procfs file read:" << (status && status->view().startsWith("Name:"));
+#endif
+
+    Expected<PooledBuffer, int> missing = co_await readFile("/nonexistent/file");
+    qDebug() << "missing file error:" << (missing ? 0 : missing.error()) << "ENOENT:" << ENOENT;
+}
+
+Async<> MyObject::testFdReadiness()
+{
+    Marker m(__PRETTY_FUNCTION__);
+
+    int fds[2];
+    if (::pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0) {
+        qDebug() << "pipe2() failed:" << errno;
+        co_return;
+    }
+
+    QList<int> order;
+    MyObject *doomed = new MyObject("doomed");
+    awaitReadable(fds[0], 1, &order);
+    doomed->awaitReadable(fds[0], 2, &order);
+    awaitReadable(fds[0], 3, &order);
+    // its' waiter is unlinked, the rest share the same notifier
+    delete doomed;
+
+    QTimer::singleShot(100, this, [fd = fds[1]] {
+        qDebug() << "writing into pipe" << ::write(fd, "x", 1);
+    });
+    co_await readable(fds[0]);
+    qDebug() << "waiters resumed in order:" << order;
+
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+Async<> MyObject::benchFdPingPong()
+{
+    Marker m(__PRETTY_FUNCTION__);
+
+    int ping[2];
+    int pong[2];
+    if (::pipe2(ping, O_NONBLOCK | O_CLOEXEC) < 0 || ::pipe2(pong, O_NONBLOCK | O_CLOEXEC) < 0) {
+        qDebug() << "pipe2() failed:" << errno;
+        co_return;
+    }
+
+    const int rounds = 100000;
+    MyObject echo("echo");
+    echo.echoBytes(ping[0], pong[1], rounds);
+
+    QElapsedTimer timer;
+    timer.start();
+    char byte = 'x';
+    for (int i = 0; i < rounds; ++i) {
+        if (::write(ping[1], &byte, 1) != 1) {
+            break;
+        }
+        co_await readable(pong[0]);
+        if (::read(pong[0], &byte, 1) != 1) {
+            break;
+        }
+    }
+    const qint64 elapsed = timer.nsecsElapsed();
+    qDebug() << rounds << "round trips through a pair of pipes," << elapsed / rounds / 1000.0 << "us per round trip";
+
+    ::close(ping[0]);
+    ::close(ping[1]);
+    ::close(pong[0]);
+    ::close(pong[1]);
+}
+
+Async<> MyObject::testAsyncGenerator()
+{
+    Marker m(__PRETTY_FUNCTION__);
+
+    AsyncGenerator<int> numbers = countdown(3);
+
+    qDebug() << "consuming generator";
+
+    while (std::optional<int> number = co_await numbers.next()) {
+        qDebug() << "generated:" << *number;
+    }
+
+    qDebug() << "generator exhausted";
+}
+
+Async<> MyObject::testAsyncGeneratorAbandoned()
+{
+    Marker m(__PRETTY_FUNCTION__);
+
+    {
+        AsyncGenerator<int> numbers = countdown(3);
+        std::optional<int> number = co_await numbers.next();
+        qDebug() << "generated:" << *number << "and that's enough";
+    }
+
+    qDebug() << "generator abandoned";
+
+    AsyncGenerator<int> numbers = countdown(3);
+    std::optional<int> number = co_await numbers.next();
+    qDebug() << "generated:" << *number << "and switching to another one";
+    numbers = countdown(2);
+    number = co_await numbers.next();
+    qDebug() << "generated:" << *number << "by replacement";
+}
+
+Async<> MyObject::testAsyncGeneratorOwnerDestroyed()
+{
+    Marker m(__PRETTY_FUNCTION__);
+
+    MyObject *child = new MyObject("child");
+    QTimer::singleShot(300, child, &QObject::deleteLater);
+
+    AsyncGenerator<int> numbers = child->countdown(5);
+
+    while (std::optional<int> number = co_await numbers.next()) {
+        qDebug() << "generated:" << *number;
+    }
+
+    qCritical() << __PRETTY_FUNCTION__ << "unreachable!";
+}
+
+Async<> MyObject::testAsyncGeneratorOwnerDestroyedBetweenNext()
+{
+    Marker m(__PRETTY_FUNCTION__);
+
+    MyObject *child = new MyObject("child");
+    AsyncGenerator<int> numbers = child->countdown(5);
+
+    std::optional<int> number = co_await numbers.next();
+    qDebug() << "generated:" << *number;
+
+    // generator is suspended on `co_yield`, nobody is linked to it
+    delete child;
+
+    number = co_await numbers.next();
+    qCritical() << __PRETTY_FUNCTION__ << "unreachable!" << number.has_value();
+}
+
+Async<> MyObject::benchJobScaling()
+{
+    Marker m(__PRETTY_FUNCTION__);
+
+    constexpr int n = 36;
+
+    QList<int> counts;
+    for (int threads = 1; threads < QThread::idealThreadCount(); threads *= 2) {
+        counts.append(threads);
+    }
+    counts.append(QThread::idealThreadCount());
+
+    double single = 0;
+    for (int threads : counts) {
+        JobExecutor executor(threads);
+
+        QElapsedTimer timer;
+        timer.start();
+        qint64 result = co_await fib(executor, n);
+        double seconds = timer.nsecsElapsed() / 1e9;
+
+        if (threads == 1) {
+            single = seconds;
+        }
+        qDebug() << "fib(" << n << ") =" << result << "on" << threads << "threads in" << seconds << "s,"
+                 << "speedup" << single / seconds;
+    }
+}
+
+Async<> MyObject::testJobOwnerDestroyed()
+{
+    Marker m(__PRETTY_FUNCTION__);
+
+    bool resumed = false;
+    MyObject *doomed = new MyObject("doomed");
+    // few seconds on a single core if not canceled, so regression fails the check below instead of hanging
+    doomed->awaitFib(44, &resumed);
+
+    QTimer pause;
+    pause.setSingleShot(true);
+    pause.start(10);
+    co_await CoSignal(&pause, &QTimer::timeout);
+
+    qDebug() << "destroying owner after" << fib_leaves.load() << "leaves";
+    delete doomed;
+
+    // leaves already running when graph was canceled finish, nothing new starts after that
+    pause.start(100);
+    co_await CoSignal(&pause, &QTimer::timeout);
+    qint64 settled = fib_leaves.load();
+    pause.start(100);
+    co_await CoSignal(&pause, &QTimer::timeout);
+
+    if (resumed) {
+        qCritical() << __PRETTY_FUNCTION__ << "job result arrived after owner was destroyed";
+    }
+    if (qint64 late = fib_leaves.load() - settled) {
+        qCritical() << __PRETTY_FUNCTION__ << "job graph still running after owner was destroyed:" << late << "new leaves";
+    }
+}
+
 Async<> MyObject::setPromiseResult()
 {
     Marker m(__PRETTY_FUNCTION__);
-    co_await QtConcurrent::run(&concurrent_without_result, 1);
+    co_await VirtualTime::run(&concurrent_without_result, 1);
     m_promise.addResult(1);
     m_promise.finish();
     // corouting awaiting on QFuture of m_promise will wake up
@@ -348,7 +1189,13 @@ Async<> MyObject::setPromiseResult()
 void MyObject::failPromise()
 {
     Marker m(__PRETTY_FUNCTION__);
+#ifndef QT_NO_EXCEPTIONS
     m_promise.setException(QException());
+#else
+    m_promise.future().cancel();
+#endif
+    // continuations are only run once promise is finished
+    m_promise.finish();
 }
 
 Async<QMessageBox::ButtonRole> MyObject::messageBox(QString question)
@@ -361,10 +1208,106 @@ Async<QMessageBox::ButtonRole> MyObject::messageBox(QString question)
     co_return role;
 }
 
+Async<Expected<int>> MyObject::doubled(QFuture<int> future)
+{
+    Marker m(__PRETTY_FUNCTION__);
+    // canceled future finishes this coroutine right here, with the error
+    int value = co_await co_await tryAwait(future);
+    qDebug() << "future result:" << value;
+    co_return value * 2;
+}
+
+Async<> MyObject::awaitShared(SharedAsync<int> shared, int *resumed)
+{
+    co_await shared;
+    ++*resumed;
+}
+
+Async<> MyObject::awaitCached(AsyncCache<int, QString> *cache, int key, int *loads)
+{
+    QString value = co_await cache->get(key, counting_loader(loads));
+    Q_UNUSED(value);
+}
+
+static void reportThread(QObject *owner, const char *wakeUp)
+{
+    if (QThread::currentThread() != owner->thread()) {
+        qCritical() << wakeUp << "resumed coroutine in wrong thread";
+        return;
+    }
+    qDebug() << wakeUp << "resumed coroutine in owner's current thread";
+}
+
+Async<> MyObject::awaitDebounced()
+{
+    CoSignal debounced(this, &MyObject::signal1, CoSignalFlags::Debounce, 100);
+    co_await debounced;
+    reportThread(this, "debounced signal");
+}
+
+Async<> MyObject::awaitYield()
+{
+    co_await yieldNow();
+    reportThread(this, "yield");
+}
+
+Async<> MyObject::awaitYieldInOrder(int id, QList<int> *order, MyObject **doomed)
+{
+    co_await yieldNow();
+    order->append(id);
+    if (this != *doomed) {
+        delete std::exchange(*doomed, nullptr);
+    }
+}
+
+Async<> MyObject::awaitFuture()
+{
+    co_await VirtualTime::run(&concurrent_without_result, 1);
+    reportThread(this, "future");
+}
+
+Async<> MyObject::awaitFib(int n, bool *resumed)
+{
+    qint64 result = co_await fib(JobExecutor::global(), n);
+    qDebug() << "fib(" << n << ") =" << result;
+    *resumed = true;
+}
+
+Async<> MyObject::awaitFileRead(QString path, bool *resumed)
+{
+    Expected<PooledBuffer, int> data = co_await readFile(path);
+    reportThread(this, "file read");
+    if (resumed) {
+        *resumed = true;
+    }
+}
+
+Async<> MyObject::awaitReadable(int fd, int id, QList<int> *order)
+{
+    co_await readable(fd);
+    order->append(id);
+}
+
+Async<> MyObject::echoBytes(int in, int out, int rounds)
+{
+    char byte;
+    for (int i = 0; i < rounds; ++i) {
+        co_await readable(in);
+        if (::read(in, &byte, 1) != 1 || ::write(out, &byte, 1) != 1) {
+            co_return;
+        }
+    }
+}
+
+Async<int> MyObject::readyValue(int x)
+{
+    co_return x + 1;
+}
+
 Async<int> MyObject::coroSleep(int seconds)
 {
     Marker m(__PRETTY_FUNCTION__);
-    co_await QtConcurrent::run(&concurrent_without_result, seconds);
+    co_await VirtualTime::run(&concurrent_without_result, seconds);
     co_return seconds;
 }
 
@@ -380,7 +1323,29 @@ Async<> MyObject::chain(QList<MyObject*> objects)
     }
 
     qDebug() << "awaiting concurrent";
-    co_await QtConcurrent::run(&concurrent_without_result, 1);
+    co_await VirtualTime::run(&concurrent_without_result, 1);
+}
+
+Async<> MyObject::pump(QIODevice *device, qint64 total, qint64 chunk)
+{
+    QByteArray data(chunk, 'x');
+    for (qint64 sent = 0; sent < total; sent += chunk) {
+        if (co_await writeAll(device, data) < 0) {
+            qCritical() << "write failed:" << device->errorString();
+            co_return;
+        }
+    }
+}
+
+AsyncGenerator<int> MyObject::countdown(int from)
+{
+    Marker m(QString("%1 %2(%3)").arg(__PRETTY_FUNCTION__).arg(objectName()).arg(from));
+
+    for (int i = from; i > 0; --i) {
+        QTimer::singleShot(100, this, [this] { emit signal3(); });
+        co_await CoSignal(this, &MyObject::signal3);
+        co_yield i;
+    }
 }
 
 MessageBox::MessageBox(QString text)
@@ -1,15 +1,46 @@
 #pragma once
 
 #include <QObject>
+#include <QThread>
 #include <QMessageBox>
 
 #include "qcosignal.hpp"
 
+template<typename K, typename V>
+struct AsyncCache;
+
+/*
+ * payload counting how many times it was copied on its' way and remembering where the last copy was made
+ */
+struct TrackedPayload
+{
+    TrackedPayload() = default;
+    explicit TrackedPayload(QByteArray bytes) : bytes(std::move(bytes)) {}
+
+    TrackedPayload(const TrackedPayload &other)
+        : bytes(other.bytes), copies(other.copies + 1), copiedIn(QThread::currentThread())
+    {}
+    TrackedPayload &operator=(const TrackedPayload &other)
+    {
+        bytes = other.bytes;
+        copies = other.copies + 1;
+        copiedIn = QThread::currentThread();
+        return *this;
+    }
+    TrackedPayload(TrackedPayload &&) = default;
+    TrackedPayload &operator=(TrackedPayload &&) = default;
+
+    QByteArray bytes;
+    int copies = 0;
+    QThread *copiedIn = nullptr;
+};
+
 class MyObject: public QObject
 {
     Q_OBJECT
 public:
     static void runTest(Async<>(MyObject::*testFunction)(void));
+    static int aliveCoroutines();
 
     MyObject(QString name);
     virtual ~MyObject();
@@ -22,9 +53,26 @@ public:
     Async<> testAwaitFutureWithResult();
     Async<> testAwaitFutureWithoutResult();
 
+    Async<> testCoSignalModes();
+    Async<> testCoSignalCrossThread();
+    Async<> testAnyOf();
+    Async<> testAnyOfSendersDestroyed();
+
+    Async<> testTryAwaitFuture();
+    Async<> testTryAwaitSenderDestroyed();
+
+    Async<> testSharedAsync();
+    Async<> testAsyncCache();
+    Async<> testYieldToEventLoop();
+    Async<> testYieldFanOut();
+    Async<> testMoveToThread();
+    Async<> testMoveToThreadAndDestroy();
+    Async<> testThreadExitWithFileReadInFlight();
+
     Async<> testSpawnCoroViaSignal();
 
     Async<> testAwaitCoro();
+    Async<> benchReadyPath();
 
     Async<> testAwaitSignalOwnerDestroyed();
     Async<> testAwaitSignalSenderDestroyed();
@@ -40,10 +88,31 @@ public:
     Async<> testShootInMyFingFootAndMiss();
     Async<> testShootInMyFingFootAndMiss2();
     Async<> testShootInMyFingFootAndHit();
+
+    Async<> testAwaitIODevice();
+    Async<> benchIODeviceThroughput();
+
+    Async<> testRunProcess();
+    Async<> testProcessStream();
+    Async<> testProcessOwnerDestroyed();
+
+    Async<> testAwaitFileIO();
+
+    Async<> testFdReadiness();
+    Async<> benchFdPingPong();
+
+    Async<> testAsyncGenerator();
+    Async<> testAsyncGeneratorAbandoned();
+    Async<> testAsyncGeneratorOwnerDestroyed();
+    Async<> testAsyncGeneratorOwnerDestroyedBetweenNext();
+
+    Async<> benchJobScaling();
+    Async<> testJobOwnerDestroyed();
 signals:
     void signal1(int arg);
     void signal2(int arg, QString arg2);
     void signal3();
+    void payload(TrackedPayload data);
     void button(QMessageBox::ButtonRole role);
 
 private slots:
@@ -52,8 +121,22 @@ private slots:
 
 private:
     Async<QMessageBox::ButtonRole> messageBox(QString question);
+    Async<Expected<int>> doubled(QFuture<int> future);
+    Async<> awaitShared(SharedAsync<int> shared, int *resumed);
+    Async<> awaitCached(AsyncCache<int, QString> *cache, int key, int *loads);
+    Async<> awaitDebounced();
+    Async<> awaitYield();
+    Async<> awaitYieldInOrder(int id, QList<int> *order, MyObject **doomed);
+    Async<> awaitFuture();
+    Async<> awaitFib(int n, bool *resumed);
+    Async<> awaitFileRead(QString path, bool *resumed = nullptr);
+    Async<> awaitReadable(int fd, int id, QList<int> *order);
+    Async<> echoBytes(int in, int out, int rounds);
+    Async<int> readyValue(int x);
     Async<int> coroSleep(int seconds);
     Async<> chain(QList<MyObject*> objects);
+    Async<> pump(QIODevice *device, qint64 total, qint64 chunk);
+    AsyncGenerator<int> countdown(int from);
 
     QPromise<int> m_promise;
 };
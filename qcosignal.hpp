@@ -1,166 +1,289 @@
 #pragma once
 
+#include <array>
+#include <chrono>
 #include <coroutine>
+#include <cstdlib>
 #include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <utility>
+#include <variant>
+#include <vector>
 
 #include <QObject>
 #include <QFuture>
 #include <QTimer>
+#include <QCoreApplication>
+#include <QAbstractEventDispatcher>
+#include <QThread>
+#include <QEvent>
 
 #ifdef COSIGNAL_DEBUG
-#include <QCoreApplication>
 #include <QDebug>
 #endif
 
+#ifdef COSIGNAL_FRAME_STATS
+#include <atomic>
+#endif
+
+#include "qcosignal_abort.hpp"
+
+#ifdef COSIGNAL_METRICS
+#include "qcosignal_metrics.hpp"
+#endif
+
+// =============================================================================
+
 /*
- * minimal support for `co_await`-ing of QFuture<T>
- * doesn't handle cancellation or failure of QFuture
- * in those cases awating coroutine will hang in memory until its' owning QObject is destroyed
+ * why awaiting wrapped with `tryAwait()` has failed, instead of aborting the coroutine
+ */
+enum class AwaitError
+{
+    // awaited QFuture was canceled or failed (failed futures are reported as canceled too)
+    Canceled,
+    // sender of awaited signal was destroyed
+    SenderDestroyed,
+};
+
+template<typename E>
+struct Unexpected
+{
+    E error;
+};
+
+template<typename E>
+Unexpected(E) -> Unexpected<E>;
+
+/*
+ * value or error, for code built without exceptions (poor man's C++23 `std::expected`)
  *
- * also actually supports only copiable T - int, QString, etc.
- * should be enough for everyone, right?
+ *   Async<Expected<int>> Class::load()
+ *   {
+ *       Expected<QByteArray> data = co_await tryAwait(future);
+ *       if (!data) {
+ *           co_return Unexpected{data.error()};
+ *       }
+ *       ...
+ *   }
+ *
+ * or shorter, `co_await`-ing Expected inside of `Async<Expected<...>>` coroutine returns
+ * the value or finishes coroutine right away with the error (like `?` in Rust):
+ *
+ *       QByteArray data = co_await co_await tryAwait(future);
  */
-template<typename T>
-struct FutureAwaiter
+template<typename T, typename E = AwaitError>
+struct Expected
 {
-    FutureAwaiter(QFuture<T> future, QObject *object)
+    using value_type = T;
+    using error_type = E;
+    // std::variant<void, ...> is forbidden too
+    using Value = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+    Expected()
+        : m_storage(std::in_place_index<0>)
+    {}
+
+    template<typename U = Value>
+    requires std::is_constructible_v<Value, U&&> && (!std::is_same_v<std::remove_cvref_t<U>, Expected>)
+    Expected(U&& value)
+        : m_storage(std::in_place_index<0>, std::forward<U>(value))
+    {}
+
+    template<typename G>
+    requires std::is_constructible_v<E, G&&>
+    Expected(Unexpected<G> error)
+        : m_storage(std::in_place_index<1>, std::move(error.error))
+    {}
+
+    bool has_value() const
     {
-        m_future = future;
-        setup_then(object);
-        // TODO?
-        // setup_failed(object);
+        return m_storage.index() == 0;
     }
 
-    template<typename Dummy = T>
-    requires std::is_void_v<T>
-    void setup_then(QObject *object)
+    explicit operator bool() const
     {
-        m_future.then(object, [this] () { m_handle.resume(); });
+        return has_value();
     }
 
     template<typename Dummy = T>
     requires (!std::is_void_v<T>)
-    void setup_then(QObject *object)
+    Dummy &value() &
     {
-        m_future.then(object, [this] (T) { m_handle.resume(); });
+        check();
+        return *std::get_if<0>(&m_storage);
     }
 
-    bool await_ready() const
+    template<typename Dummy = T>
+    requires (!std::is_void_v<T>)
+    const Dummy &value() const &
     {
-        return m_future.isFinished();
+        check();
+        return *std::get_if<0>(&m_storage);
     }
 
-    void await_suspend(std::coroutine_handle<> handle)
+    template<typename Dummy = T>
+    requires (!std::is_void_v<T>)
+    Dummy &&value() &&
     {
-        m_handle = handle;
+        check();
+        return std::move(*std::get_if<0>(&m_storage));
     }
 
     template<typename Dummy = T>
-    requires std::is_void_v<T>
-    void await_resume()
+    requires (!std::is_void_v<T>)
+    Dummy value_or(Dummy fallback) const &
     {
-        return;
+        return has_value() ? *std::get_if<0>(&m_storage) : fallback;
     }
 
-    template<typename Dummy = T>
-    requires (!std::is_void_v<T>)
-    T await_resume()
+    decltype(auto) operator*() &
     {
-        return m_future.result();
+        return value();
     }
 
-private:
-    QFuture<T> m_future;
-    std::coroutine_handle<> m_handle;
-};
+    decltype(auto) operator*() const &
+    {
+        return value();
+    }
 
-// =============================================================================
+    decltype(auto) operator*() &&
+    {
+        return std::move(*this).value();
+    }
 
-/*
- * some forward declarations
- */
+    auto operator->()
+    {
+        return &value();
+    }
 
-template<typename T = void>
-struct CoroutineControllerBase;
+    auto operator->() const
+    {
+        return &value();
+    }
 
-template<typename T = void>
-struct CoroutineController;
+    E &error()
+    {
+        Q_ASSERT(!has_value());
+        return std::get_if<1>(&m_storage)->error;
+    }
 
-using Handle = std::coroutine_handle<CoroutineController<>>;
+    const E &error() const
+    {
+        Q_ASSERT(!has_value());
+        return std::get_if<1>(&m_storage)->error;
+    }
 
-// =============================================================================
+private:
+    void check() const
+    {
+        // nothing to throw with -fno-exceptions
+        if (!has_value()) {
+            Q_ASSERT_X(false, __PRETTY_FUNCTION__, "accessing value of failed Expected");
+            std::abort();
+        }
+    }
+
+    std::variant<Value, Unexpected<E>> m_storage;
+};
+
+template<typename T>
+struct IsExpected : std::false_type {};
+
+template<typename T, typename E>
+struct IsExpected<Expected<T, E>> : std::true_type {};
 
 /*
- * state shared between publicly visible type Async<T>
- * and internal "promise_type" — CoroutineControllerBase<T>
+ * minimal support for `co_await`-ing of QFuture<T>
+ * canceled or failed QFuture aborts awaiting coroutine (AbortReason::Other)
+ * (`co_await tryAwait(future)` resumes it with an error instead, returning Expected)
+ *
+ * also actually supports only copiable T - int, QString, etc.
+ * should be enough for everyone, right?
  */
 template<typename T>
-struct SharedState
+struct FutureAwaiter
 {
-    SharedState(CoroutineControllerBase<T> *promise)
-        : current(reinterpret_cast<CoroutineControllerBase<>*>(promise))
+    FutureAwaiter(QFuture<T> future, QObject *object)
+        : m_future(future)
+        , m_object(object)
     {}
 
-    CoroutineControllerBase<> *current = nullptr;
-    /*
-     * caller of the `current`, i.e.
-     *
-     *   Async<> Class::up()
-     *   {
-     *     ...
-     *     co_await current();
-     *     ...
-     *   }
-     */
-    CoroutineControllerBase<> *up = nullptr;
-    /*
-     * called by the `current`, i.e.
-     *
-     *   Async<> Class::current()
-     *   {
-     *     ...
-     *     co_await down();
-     *     ...
-     *   }
-     */
-    CoroutineControllerBase<> *down = nullptr;
+    ~FutureAwaiter()
+    {
+        // coroutine is gone (finished or aborted), continuation must not touch it
+        if (m_handle) {
+            *m_handle = nullptr;
+        }
+    }
 
+#ifdef COSIGNAL_METRICS
     /*
-     * std::optional<void> is forbidden, so when `T = void` using bool as result type
-     * can be optimized to `bool result` via some template magic
+     * finishing time is stamped right in the finishing thread by synchronous continuation,
+     * resuming continuation is chained after it
      */
-    std::optional<std::conditional_t<std::is_void_v<T>, bool, T>> result;
-
-#ifdef COSIGNAL_DEBUG
-    // for example running purposes
-    bool exitLoop = false;
+    QFuture<T> upstream()
+    {
+        m_finishedAt = std::make_shared<std::atomic<qint64>>(0);
+        if constexpr (std::is_void_v<T>) {
+            return m_future.then(QtFuture::Launch::Sync, [finishedAt = m_finishedAt] {
+                finishedAt->store(CoroutineMetrics::now(), std::memory_order_relaxed);
+            });
+        } else {
+            return m_future.then(QtFuture::Launch::Sync, [finishedAt = m_finishedAt] (const T &value) {
+                finishedAt->store(CoroutineMetrics::now(), std::memory_order_relaxed);
+                return value;
+            });
+        }
+    }
+#else
+    QFuture<T> upstream()
+    {
+        return m_future;
+    }
 #endif
-};
-
-/*
- * publicly visible coroutine type
- * analogous to python's `asyncio.Task`
- *
- * fields are public for simplicity
- */
-template<typename T = void>
-struct Async
-{
-    Async(std::shared_ptr<SharedState<T>> state)
-        : m_state(state)
-    {}
 
     bool await_ready() const
     {
-        return m_state->result.has_value();
+        // canceled one suspends too, to be aborted by continuation
+        return m_future.isFinished() && !m_future.isCanceled();
     }
 
-    void await_suspend(std::coroutine_handle<> untypedHandle);
+    template<typename Promise>
+    void await_suspend(std::coroutine_handle<Promise> handle)
+    {
+        /*
+         * continuation is set up only when actually suspending,
+         * and it shares handle with `this`, so if coroutine is aborted
+         * before future finishes — it won't be resumed from the grave
+         */
+        m_handle = std::make_shared<std::coroutine_handle<>>(handle);
+        auto finished = [handle = m_handle] (bool canceled) {
+            if (!*handle) {
+                return;
+            }
+            if (!canceled) {
+                handle->resume();
+                return;
+            }
+#ifdef COSIGNAL_DEBUG
+            qDebug() << "aborting coroutine because awaited future was canceled or failed";
+#endif
+            std::coroutine_handle<Promise>::from_address(handle->address()).promise().abort(AbortReason::Other);
+        };
+
+        // same as in TryFuture, failed futures are canceled as well
+        upstream()
+            .then(m_object, [finished] (QFuture<T> future) { finished(future.isCanceled()); })
+            .onCanceled(m_object, [finished] { finished(true); });
+    }
 
     template<typename Dummy = T>
     requires std::is_void_v<T>
     void await_resume()
     {
+        record_latency();
         return;
     }
 
@@ -168,408 +291,2289 @@ struct Async
     requires (!std::is_void_v<T>)
     T await_resume()
     {
-        return m_state->result.value();
+        record_latency();
+        return m_future.result();
     }
 
-    std::shared_ptr<SharedState<T>> m_state;
+private:
+    void record_latency()
+    {
+#ifdef COSIGNAL_METRICS
+        if (m_finishedAt && m_finishedAt->load(std::memory_order_relaxed)) {
+            CoroutineMetrics::futureResumed(m_finishedAt->load(std::memory_order_relaxed));
+        }
+#endif
+    }
+
+    QFuture<T> m_future;
+    QObject *m_object;
+    std::shared_ptr<std::coroutine_handle<>> m_handle;
+#ifdef COSIGNAL_METRICS
+    std::shared_ptr<std::atomic<qint64>> m_finishedAt;
+#endif
 };
 
+// =============================================================================
+
 /*
- * await controller returned from final_suspend()
- * if there is upstack coroutine, it will be indicated for resumption
+ * named awaitable (e.g. CoSignal awaited in a loop) must stay the very same object between
+ * `co_await`-s, but some compilers (gcc 12) copy whatever reference `await_transform()` returns
+ * so it's passed around wrapped
  */
-struct Continuation
+template<typename A>
+struct AwaitableRef
 {
-    CoroutineControllerBase<> *up;
+    bool await_ready()
+    {
+        return awaitable.await_ready();
+    }
 
-    bool await_ready() const noexcept
+    template<typename H>
+    decltype(auto) await_suspend(H handle)
     {
-        return !up;
+        return awaitable.await_suspend(handle);
     }
 
-    std::coroutine_handle<> await_suspend(std::coroutine_handle<>) noexcept;
+    decltype(auto) await_resume()
+    {
+        return awaitable.await_resume();
+    }
 
-    void await_resume() noexcept {}
+    A &awaitable;
 };
 
 /*
- * main piece of code, controlling behavior of coroutines
- * (hence the name, because C++'s own "promise_type" is oh so unambiguous)
- *
- * binds itself to QObject's lifetime and follows it into deleted oblivion
+ * coroutine is bound to its' owner only once it actually suspends — the ones completing
+ * right away don't pay for connecting to (and disconnecting from) `QObject::destroyed`
  */
-template<typename T>
-struct CoroutineControllerBase
+template<typename A>
+struct OwnerWatch
 {
-    template<typename... Args>
-    CoroutineControllerBase(QObject &object, Args...)
-        : m_object(&object)
-        , m_state(new SharedState<T>(this))
+    bool await_ready()
     {
-        // When `object` is being destroyed, also abort and destroy dangling coroutine_handle
-        m_connection = QObject::connect(
-            &object,
-            &QObject::destroyed,
-            [this] {
-#ifdef COSIGNAL_DEBUG
-                qDebug() << "aborting coroutine because owning object was destroyed";
-#endif
-                abort();
-            }
-        );
+        return awaiter.await_ready();
     }
 
-#ifdef COSIGNAL_DEBUG
-    virtual ~CoroutineControllerBase()
+    template<typename H>
+    decltype(auto) await_suspend(H handle)
     {
-        // some sanity checks
-        Q_ASSERT(!m_state->up);
-        Q_ASSERT(!m_state->down);
-
-        // if this is main test coroutine => exiting event loop
-        if (m_state->exitLoop) {
-            QCoreApplication::instance()->exit();
-        }
+        // before, `await_suspend()` may resume or even destroy the coroutine
+        handle.promise().watch_owner();
+        return awaiter.await_suspend(handle);
     }
-#endif
 
-    std::coroutine_handle<CoroutineControllerBase> make_handle()
+    decltype(auto) await_resume()
     {
-        return std::coroutine_handle<CoroutineControllerBase>::from_promise(*this);
+        return awaiter.await_resume();
     }
 
-    void abort()
+    A awaiter;
+};
+
+#ifdef COSIGNAL_METRICS
+/*
+ * records how long coroutine stayed suspended on the wrapped awaitable
+ */
+template<typename A, AwaitKind Kind>
+struct MeasuredAwaiter
+{
+    bool await_ready()
     {
-        /*
-         * gracefully aborting running coroutine
-         */
-        QObject::disconnect(m_connection);
-        m_state->current = nullptr;
+        return awaiter.await_ready();
+    }
 
-        /*
-         * recursive quasi stack-unwinding
-         * 1) descend down (from calling to called coroutine) to the lowest level,
-         *    breaking links on the way
-         * 2) destroy lowest coroutine frame
-         * 3) backtrack to starting point, destroying previous frames
-         * 4) ascend up, destroying frames on every step
-         */
+    template<typename H>
+    decltype(auto) await_suspend(H handle)
+    {
+        // stamped before, `await_suspend()` may resume or even destroy the coroutine
+        suspendedAt = CoroutineMetrics::now();
 
         /*
-         * first and foremost — break links to prevent infinite recursion (and double free)
+         * awaiter may decide not to suspend after all — `false` or own handle is returned then,
+         * coroutine is still here and keeps running, so there is no suspension to record
          */
-        CoroutineControllerBase<> *down = m_state->down;
-        if (down) {
-            down->m_state->up = nullptr;
-            m_state->down = nullptr;
+        using R = decltype(awaiter.await_suspend(handle));
+        if constexpr (std::is_same_v<R, bool>) {
+            const bool suspended = awaiter.await_suspend(handle);
+            if (!suspended) {
+                suspendedAt = 0;
+            }
+            return suspended;
+        } else if constexpr (std::is_void_v<R>) {
+            awaiter.await_suspend(handle);
+        } else {
+            auto next = awaiter.await_suspend(handle);
+            if (next.address() == handle.address()) {
+                suspendedAt = 0;
+            }
+            return next;
         }
+    }
 
-        CoroutineControllerBase<> *up = m_state->up;
-        if (up) {
-            up->m_state->down = nullptr;
-            m_state->up = nullptr;
+    decltype(auto) await_resume()
+    {
+        if (suspendedAt) {
+            CoroutineMetrics::suspended(Kind, suspendedAt);
         }
+        return awaiter.await_resume();
+    }
 
-        if (down) {
-#ifdef COSIGNAL_DEBUG
-            qDebug() << "aborting downstack coroutine because current was aborted";
+    A awaiter;
+    qint64 suspendedAt = 0;
+};
 #endif
-            down->abort();
-        }
 
-        auto handle = make_handle();
-        Q_ASSERT(handle);
-        handle.destroy();
+// =============================================================================
 
-        // at this point `this` could be dangling pointer, so we should careful not to touch it
+#ifdef COSIGNAL_FRAME_STATS
+/*
+ * accounting of coroutine frames, for leak hunting (see soak.cpp)
+ * counters are process-wide, coroutines may live in different threads
+ */
+struct CoroutineFrameStats
+{
+    static inline std::atomic<qint64> live = 0;
+    static inline std::atomic<qint64> allocated = 0;
+    static inline std::atomic<qint64> liveBytes = 0;
+};
+#endif
+
+#ifndef COSIGNAL_FRAME_POOL
+// 0 — every frame and state goes straight to the heap (e.g. for sanitizers to see them)
+#define COSIGNAL_FRAME_POOL 1
+#endif
+
+/*
+ * per-thread free lists of coroutine frames and their shared states, by 64 byte size class
+ *
+ * most coroutines are short-lived (and many complete without ever suspending), so both allocations
+ * of every call are recycled instead of going through malloc — frames can't be elided by
+ * the compiler (HALO), their handles escape into the state to be aborted along with the owner
+ *
+ * block may be released by another thread (owner moved with `moveToThread()`),
+ * it's simply kept by that thread's pool then
+ */
+class FramePool
+{
+public:
+    static constexpr std::size_t Granularity = 64;
+    static constexpr std::size_t MaxPooledSize = 1024;
+    // all size classes together, so idle thread (e.g. of a pool, which never exits) holds at most that much
+    static constexpr std::size_t MaxFreeBytes = 256 * 1024;
+
+    static void *allocate(std::size_t size)
+    {
+#if COSIGNAL_FRAME_POOL
+        if (size <= MaxPooledSize) {
+            if (!t_destroyed) {
+                FramePool &pool = local();
+                FreeList &list = pool.m_lists[sizeClass(size)];
+                if (Block *block = list.head) {
+                    list.head = block->next;
+                    pool.m_freeBytes -= (sizeClass(size) + 1) * Granularity;
+                    return block;
+                }
+            }
+            // rounded up, so block can be reused by any frame of the same class
+            return ::operator new((sizeClass(size) + 1) * Granularity);
+        }
+#endif
+        return ::operator new(size);
+    }
+
+    static void deallocate(void *pointer, std::size_t size)
+    {
+#if COSIGNAL_FRAME_POOL
+        if (size <= MaxPooledSize) {
+            // unless thread is exiting and its' pool is gone already
+            if (!t_destroyed) {
+                FramePool &pool = local();
+                const std::size_t blockSize = (sizeClass(size) + 1) * Granularity;
+                if (pool.m_freeBytes + blockSize <= MaxFreeBytes) {
+                    FreeList &list = pool.m_lists[sizeClass(size)];
+                    list.head = new (pointer) Block{list.head};
+                    pool.m_freeBytes += blockSize;
+                    return;
+                }
+            }
+            ::operator delete(pointer, (sizeClass(size) + 1) * Granularity);
+            return;
+        }
+#endif
+        ::operator delete(pointer, size);
+    }
+
+    FramePool(const FramePool &) = delete;
+    FramePool &operator=(const FramePool &) = delete;
+
+private:
+    struct Block
+    {
+        Block *next;
+    };
+
+    struct FreeList
+    {
+        Block *head = nullptr;
+    };
+
+    FramePool() = default;
+
+    // thread is exiting, whatever it has pooled goes back to the heap
+    ~FramePool()
+    {
+        // frames released after this (by other thread_local-s' destructors) aren't pooled
+        t_destroyed = true;
+        for (std::size_t i = 0; i < m_lists.size(); ++i) {
+            while (Block *block = m_lists[i].head) {
+                m_lists[i].head = block->next;
+                ::operator delete(block, (i + 1) * Granularity);
+            }
+        }
+    }
+
+    static std::size_t sizeClass(std::size_t size)
+    {
+        return size ? (size - 1) / Granularity : 0;
+    }
+
+    static FramePool &local()
+    {
+        thread_local FramePool pool;
+        return pool;
+    }
+
+    std::array<FreeList, MaxPooledSize / Granularity> m_lists;
+    std::size_t m_freeBytes = 0;
+
+    // trivially destructible, so still readable while other thread_local-s are destroyed
+    static inline thread_local bool t_destroyed = false;
+};
+
+/*
+ * std allocator on top of FramePool, for `std::allocate_shared()` of states —
+ * state and shared_ptr's control block in one pooled block
+ */
+template<typename T>
+struct FrameAllocator
+{
+    using value_type = T;
+
+    FrameAllocator() = default;
+
+    template<typename U>
+    FrameAllocator(const FrameAllocator<U> &) noexcept
+    {}
+
+    T *allocate(std::size_t n)
+    {
+        if constexpr (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+            return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(alignof(T))));
+        } else {
+            return static_cast<T*>(FramePool::allocate(n * sizeof(T)));
+        }
+    }
+
+    void deallocate(T *pointer, std::size_t n) noexcept
+    {
+        if constexpr (alignof(T) > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+            ::operator delete(pointer, n * sizeof(T), std::align_val_t(alignof(T)));
+        } else {
+            FramePool::deallocate(pointer, n * sizeof(T));
+        }
+    }
+
+    template<typename U>
+    bool operator==(const FrameAllocator<U> &) const noexcept
+    {
+        return true;
+    }
+};
+
+// =============================================================================
+
+/*
+ * some forward declarations
+ */
+
+template<typename T = void>
+struct CoroutineControllerBase;
+
+template<typename T = void>
+struct CoroutineController;
+
+using Handle = std::coroutine_handle<CoroutineController<>>;
+
+template<typename T>
+struct SharedAsync;
+
+template<typename T>
+struct SharedAsyncAwaiter;
+
+// =============================================================================
+
+/*
+ * suspended coroutine, node of intrusive list living right in the awaiter
+ * (see SharedAsync and yieldNow())
+ */
+struct WaiterNode
+{
+    std::coroutine_handle<> handle;
+    WaiterNode *prev = nullptr;
+    WaiterNode *next = nullptr;
+    bool linked = false;
+};
+
+/*
+ * every coroutine waiting for the same thing, in order of arrival
+ */
+struct WaiterList
+{
+    bool empty() const
+    {
+        return !first;
+    }
+
+    void push_back(WaiterNode *waiter)
+    {
+        Q_ASSERT(!waiter->linked);
+        waiter->prev = last;
+        waiter->next = nullptr;
+        (last ? last->next : first) = waiter;
+        last = waiter;
+        waiter->linked = true;
+    }
+
+    void remove(WaiterNode *waiter)
+    {
+        Q_ASSERT(waiter->linked);
+        (waiter->prev ? waiter->prev->next : first) = waiter->next;
+        (waiter->next ? waiter->next->prev : last) = waiter->prev;
+        waiter->prev = waiter->next = nullptr;
+        waiter->linked = false;
+    }
+
+    WaiterNode *pop_front()
+    {
+        WaiterNode *waiter = first;
+        if (waiter) {
+            remove(waiter);
+        }
+        return waiter;
+    }
+
+    WaiterNode *first = nullptr;
+    WaiterNode *last = nullptr;
+};
+
+/*
+ * lock of per-thread registry of waiting coroutines (yield queue, fd notifiers, file I/O queue)
+ *
+ * owner may be moved to another thread while its' coroutine waits in the registry
+ * (see `post_resume_if_moved()`) and then destroyed there — coroutine is aborted and its' waiter
+ * is unlinked from another thread, while registry's thread may be waking it up at the very moment;
+ * both sides go through this lock, and waking side decides where to resume coroutine while holding it,
+ * so owner can't be destroyed in the middle
+ *
+ * shared with waiters, because registry itself is gone once its' thread exits
+ */
+struct RegistryLock
+{
+    std::mutex mutex;
+    // lives in registry's thread, `nullptr` once registry is destroyed
+    QObject *context = nullptr;
+
+    bool inRegistryThread() const
+    {
+        return context && context->thread() == QThread::currentThread();
+    }
+};
+
+// =============================================================================
+
+/*
+ * state shared between publicly visible type Async<T>
+ * and internal "promise_type" — CoroutineControllerBase<T>
+ */
+template<typename T>
+struct SharedState
+{
+    SharedState(CoroutineControllerBase<T> *promise)
+        : current(reinterpret_cast<CoroutineControllerBase<>*>(promise))
+    {}
+
+    CoroutineControllerBase<> *current = nullptr;
+    /*
+     * caller of the `current`, i.e.
+     *
+     *   Async<> Class::up()
+     *   {
+     *     ...
+     *     co_await current();
+     *     ...
+     *   }
+     */
+    CoroutineControllerBase<> *up = nullptr;
+    /*
+     * called by the `current`, i.e.
+     *
+     *   Async<> Class::current()
+     *   {
+     *     ...
+     *     co_await down();
+     *     ...
+     *   }
+     */
+    CoroutineControllerBase<> *down = nullptr;
+
+    /*
+     * coroutines awaiting on `current` via SharedAsync (instead of a single `up`),
+     * created along with the first SharedAsync
+     */
+    std::shared_ptr<WaiterList> shared;
+
+    // `current` was aborted rather than finished, e.g. generator's consumer must not take it for the end
+    bool aborted = false;
+
+    /*
+     * std::optional<void> is forbidden, so when `T = void` using bool as result type
+     * can be optimized to `bool result` via some template magic
+     */
+    std::optional<std::conditional_t<std::is_void_v<T>, bool, T>> result;
+
+#ifdef COSIGNAL_DEBUG
+    // for example running purposes
+    bool exitLoop = false;
+#endif
+};
+
+/*
+ * publicly visible coroutine type
+ * analogous to python's `asyncio.Task`
+ *
+ * fields are public for simplicity
+ */
+template<typename T = void>
+struct Async
+{
+    Async(std::shared_ptr<SharedState<T>> state)
+        : m_state(state)
+    {}
+
+    bool await_ready() const
+    {
+        return m_state->result.has_value();
+    }
+
+    void await_suspend(std::coroutine_handle<> untypedHandle);
+
+    template<typename Dummy = T>
+    requires std::is_void_v<T>
+    void await_resume()
+    {
+        return;
+    }
+
+    template<typename Dummy = T>
+    requires (!std::is_void_v<T>)
+    T await_resume()
+    {
+        return m_state->result.value();
+    }
+
+    std::shared_ptr<SharedState<T>> m_state;
+};
+
+/*
+ * await controller returned from final_suspend()
+ * if there is upstack coroutine, it will be indicated for resumption
+ */
+struct Continuation
+{
+    CoroutineControllerBase<> *up;
+    // SharedAsync waiters, resumed after `up`'s resumption is scheduled
+    std::shared_ptr<WaiterList> shared;
+
+    bool await_ready() const noexcept
+    {
+        return !up && !shared;
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<>) noexcept;
+
+    void await_resume() noexcept {}
+};
+
+/*
+ * `co_await`-ing Expected inside of `Async<Expected<...>>` coroutine:
+ * returns the value, or finishes coroutine right away with the error
+ */
+template<typename T, typename U, typename G>
+struct ErrorPropagation
+{
+    static_assert(IsExpected<T>::value, "errors can be propagated only out of Async<Expected<T, E>> coroutines");
+
+    bool await_ready() const noexcept
+    {
+        return expected.has_value();
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> handle) noexcept
+    {
+        using E = typename T::error_type;
+        promise->m_state->result.emplace(Unexpected<E>{E(std::move(expected.error()))});
+
+        /*
+         * same as running off the end of coroutine: unlinking from awaiting coroutine,
+         * destroying the frame (`this` included) and resuming awaiting one, if any
+         */
+        Continuation next = promise->final_suspend();
+        return next.await_suspend(handle);
+    }
+
+    U await_resume()
+    {
+        if constexpr (!std::is_void_v<U>) {
+            return std::move(expected).value();
+        }
+    }
+
+    Expected<U, G> expected;
+    CoroutineControllerBase<T> *promise;
+};
+
+/*
+ * main piece of code, controlling behavior of coroutines
+ * (hence the name, because C++'s own "promise_type" is oh so unambiguous)
+ *
+ * binds itself to QObject's lifetime and follows it into deleted oblivion
+ */
+template<typename T>
+struct CoroutineControllerBase
+{
+    template<typename... Args>
+    CoroutineControllerBase(QObject &object, Args...)
+        : m_object(&object)
+        // state and its' control block in one pooled allocation
+        , m_state(std::allocate_shared<SharedState<T>>(FrameAllocator<SharedState<T>>(), this))
+    {
+#ifdef COSIGNAL_METRICS
+        m_createdAt = CoroutineMetrics::now();
+        CoroutineMetrics::created();
+#endif
+    }
+
+#ifdef COSIGNAL_DEBUG
+    virtual ~CoroutineControllerBase()
+    {
+        // some sanity checks
+        Q_ASSERT(!m_state->up);
+        Q_ASSERT(!m_state->down);
+
+        // if this is main test coroutine => exiting event loop
+        if (m_state->exitLoop) {
+            QCoreApplication::instance()->exit();
+        }
+    }
+#endif
+
+    static void *operator new(std::size_t size)
+    {
+#ifdef COSIGNAL_FRAME_STATS
+        CoroutineFrameStats::live.fetch_add(1, std::memory_order_relaxed);
+        CoroutineFrameStats::allocated.fetch_add(1, std::memory_order_relaxed);
+        CoroutineFrameStats::liveBytes.fetch_add(size, std::memory_order_relaxed);
+#endif
+        return FramePool::allocate(size);
+    }
+
+    static void operator delete(void *frame, std::size_t size)
+    {
+#ifdef COSIGNAL_FRAME_STATS
+        CoroutineFrameStats::live.fetch_sub(1, std::memory_order_relaxed);
+        CoroutineFrameStats::liveBytes.fetch_sub(size, std::memory_order_relaxed);
+#endif
+        FramePool::deallocate(frame, size);
+    }
+
+    std::coroutine_handle<CoroutineControllerBase> make_handle()
+    {
+        return std::coroutine_handle<CoroutineControllerBase>::from_promise(*this);
+    }
+
+    /*
+     * when owner is destroyed, also abort and destroy dangling coroutine_handle
+     *
+     * connected at the first suspension (see OwnerWatch), until then coroutine is running
+     * right inside of its' caller, and so is the owner's code
+     */
+    void watch_owner()
+    {
+        if (m_connection) {
+            return;
+        }
+
+        m_connection = QObject::connect(
+            m_object,
+            &QObject::destroyed,
+            [this] {
+#ifdef COSIGNAL_DEBUG
+                qDebug() << "aborting coroutine because owning object was destroyed";
+#endif
+                abort(AbortReason::OwnerDestroyed);
+            }
+        );
+    }
+
+    void abort(AbortReason reason = AbortReason::Other)
+    {
+        /*
+         * gracefully aborting running coroutine
+         */
+        QObject::disconnect(m_connection);
+        m_state->current = nullptr;
+        m_state->aborted = true;
+
+#ifdef COSIGNAL_METRICS
+        CoroutineMetrics::aborted(reason, m_createdAt);
+#else
+        Q_UNUSED(reason);
+#endif
+
+        /*
+         * recursive quasi stack-unwinding
+         * 1) descend down (from calling to called coroutine) to the lowest level,
+         *    breaking links on the way
+         * 2) destroy lowest coroutine frame
+         * 3) backtrack to starting point, destroying previous frames
+         * 4) ascend up, destroying frames on every step
+         */
+
+        /*
+         * first and foremost — break links to prevent infinite recursion (and double free)
+         */
+        CoroutineControllerBase<> *down = m_state->down;
+        if (down) {
+            down->m_state->up = nullptr;
+            m_state->down = nullptr;
+        }
+
+        CoroutineControllerBase<> *up = m_state->up;
+        if (up) {
+            up->m_state->down = nullptr;
+            m_state->up = nullptr;
+        }
+
+        // outlives the frame, along with awaiters still linked into it
+        std::shared_ptr<WaiterList> shared = m_state->shared;
+
+        if (down) {
+#ifdef COSIGNAL_DEBUG
+            qDebug() << "aborting downstack coroutine because current was aborted";
+#endif
+            down->abort(AbortReason::Unwound);
+        }
+
+        auto handle = make_handle();
+        Q_ASSERT(handle);
+        handle.destroy();
+
+        // at this point `this` could be dangling pointer, so we should careful not to touch it
+
+        if (up) {
+#ifdef COSIGNAL_DEBUG
+            qDebug() << "aborting upstack coroutine because current was aborted";
+#endif
+            up->abort(AbortReason::Unwound);
+        }
+
+        if (shared) {
+            while (WaiterNode *waiter = shared->pop_front()) {
+#ifdef COSIGNAL_DEBUG
+                qDebug() << "aborting coroutine awaiting on shared one because shared was aborted";
+#endif
+                std::coroutine_handle<CoroutineControllerBase<>>::from_address(waiter->handle.address())
+                    .promise().abort(AbortReason::Unwound);
+            }
+        }
+    }
+
+    /*
+     * owner may have been moved to another thread (`moveToThread()`) while coroutine was suspended,
+     * wake-up coming from old thread's machinery is then posted to the new one
+     * (and dropped if coroutine is aborted or owner is destroyed before it's delivered)
+     *
+     * owner may be destroyed in its' new thread at any moment, so called under RegistryLock
+     * of the registry coroutine waits in, which its' awaiter takes when being destroyed
+     *
+     * returns `true` if it was posted, i.e. coroutine must not be resumed right here
+     */
+    bool post_resume_if_moved()
+    {
+        if (m_object->thread() == QThread::currentThread()) {
+            return false;
+        }
+
+#ifdef COSIGNAL_DEBUG
+        qDebug() << "resuming coroutine in the thread its' owner was moved to";
+#endif
+        auto self = reinterpret_cast<CoroutineControllerBase<>*>(this);
+        QMetaObject::invokeMethod(m_object, [state = m_state, self] {
+            if (state->current == self) {
+                self->make_handle().resume();
+            }
+        }, Qt::QueuedConnection);
+        return true;
+    }
+
+    inline Async<T> get_return_object() noexcept { return Async<T>(m_state); }
+
+    inline static std::suspend_never initial_suspend() noexcept { return {}; }
+
+    inline Continuation final_suspend() noexcept
+    {
+        QObject::disconnect(m_connection);
+        m_state->current = nullptr;
+
+#ifdef COSIGNAL_METRICS
+        CoroutineMetrics::completed(m_createdAt);
+#endif
+
+        /*
+         * if there is another coroutine, awaiting on `this` — it will be awoken
+         * after this one was destroyed (see Continuation::await_suspend())
+         */
+        Continuation next = { m_state->up, nullptr };
+        if (m_state->shared && !m_state->shared->empty()) {
+            next.shared = m_state->shared;
+        }
+
+        if (m_state->up) {
+            Q_ASSERT(reinterpret_cast<CoroutineControllerBase*>(m_state->up->m_state->down) == this);
+            m_state->up->m_state->down = nullptr;
+            m_state->up = nullptr;
+        }
+
+        return next;
+    }
+
+    /*
+     * exceptions aren't supported (and may be disabled altogether),
+     * errors are returned as values — see Expected and tryAwait()
+     */
+    inline static void unhandled_exception() noexcept
+    {
+        Q_ASSERT_X(false, __PRETTY_FUNCTION__, "not supported");
+        std::abort();
+    }
+
+    template <typename A>
+    requires (!std::is_lvalue_reference_v<A>)
+    inline static decltype(auto) await_transform(A&& someAsync)
+    {
+        // CoSignal<> and Async<> temporaries
+#ifdef COSIGNAL_METRICS
+        return OwnerWatch<MeasuredAwaiter<AwaitableRef<A>, AwaitKindOf<std::remove_cv_t<A>>::value>>{{{someAsync}}};
+#else
+        return OwnerWatch<AwaitableRef<A>>{{someAsync}};
+#endif
+    }
+
+    template <typename A>
+    inline static auto await_transform(A& someAsync)
+    {
+        // named ones
+#ifdef COSIGNAL_METRICS
+        return OwnerWatch<MeasuredAwaiter<AwaitableRef<A>, AwaitKindOf<std::remove_cv_t<A>>::value>>{{{someAsync}}};
+#else
+        return OwnerWatch<AwaitableRef<A>>{{someAsync}};
+#endif
+    }
+
+    template<typename K>
+    auto await_transform(QFuture<K> future)
+    {
+#ifdef COSIGNAL_METRICS
+        return OwnerWatch<MeasuredAwaiter<FutureAwaiter<K>, AwaitKind::Future>>{{FutureAwaiter<K>(future, m_object)}};
+#else
+        return OwnerWatch<FutureAwaiter<K>>{FutureAwaiter<K>(future, m_object)};
+#endif
+    }
+
+    template<typename U>
+    auto await_transform(const SharedAsync<U> &shared)
+    {
+        // awaiter per `co_await`, it's the node of waiters list
+#ifdef COSIGNAL_METRICS
+        return OwnerWatch<MeasuredAwaiter<SharedAsyncAwaiter<U>, AwaitKind::Coroutine>>{{SharedAsyncAwaiter<U>(shared.m_state)}};
+#else
+        return OwnerWatch<SharedAsyncAwaiter<U>>{SharedAsyncAwaiter<U>(shared.m_state)};
+#endif
+    }
+
+    template<typename U>
+    auto await_transform(SharedAsync<U> &shared)
+    {
+        return await_transform(std::as_const(shared));
+    }
+
+    template<typename U>
+    auto await_transform(SharedAsync<U> &&shared)
+    {
+        return await_transform(std::as_const(shared));
+    }
+
+    template<typename U, typename G>
+    auto await_transform(Expected<U, G> &expected)
+    {
+        return ErrorPropagation<T, U, G>{expected, this};
+    }
+
+    template<typename U, typename G>
+    auto await_transform(Expected<U, G> &&expected)
+    {
+        return ErrorPropagation<T, U, G>{std::move(expected), this};
+    }
+
+    QObject *const m_object;
+    QMetaObject::Connection m_connection;
+    const std::shared_ptr<SharedState<T>> m_state;
+#ifdef COSIGNAL_METRICS
+    qint64 m_createdAt;
+#endif
+};
+
+/*
+ * "specialization" of coroutine controller for generic case and `T = void`
+ *
+ * it's strange and funny how such inheritance scheme is basically required,
+ * because compiler forbids  simultaneous presence of both `return_value()` and `return_void()`
+ * even when they are hidden under SFINAE
+ */
+template<typename T>
+struct CoroutineController : CoroutineControllerBase<T>
+{
+    template<typename... Args>
+    CoroutineController(QObject &object, Args...)
+        : CoroutineControllerBase<T>(object)
+    {}
+
+    inline void return_value(T&& v) noexcept
+    {
+        this->m_state->result.emplace(std::forward<T>(v));
+    }
+
+    inline void return_value(T& v) noexcept
+    {
+        this->m_state->result.emplace(v);
+    }
+};
+
+template<>
+struct CoroutineController<void> : CoroutineControllerBase<void>
+{
+    template<typename... Args>
+    CoroutineController(QObject &object, Args...)
+        : CoroutineControllerBase<void>(object)
+    {}
+
+    inline void return_void() noexcept
+    {
+        m_state->result.emplace(true);
+    }
+};
+
+/*
+ * `co_await`-ing on another coroutine (referenced by `untypedHandle`)
+ */
+template<typename T>
+void Async<T>::await_suspend(std::coroutine_handle<> untypedHandle)
+{
+    /*
+     * we assume that `this` is being `co_await`-ed by another Async<X> coroutine
+     *
+     * mixing different coroutine types in single app is like replacing shotgun
+     * aimed at your foot with gatling gun — good luck
+     */
+    Handle& handle = reinterpret_cast<Handle&>(untypedHandle);
+    CoroutineController<> *up = &handle.promise();
+
+    // sanity checks
+
+    // coroutine bound with `this` is still alive
+    Q_ASSERT(m_state->current);
+
+    // it isn't being `co_await`-ed by somebody else already
+    Q_ASSERT(!m_state->up);
+
+    // both coroutines resides in the same thread
+    Q_ASSERT(up->m_object->thread() == m_state->current->m_object->thread());
+
+    // linking couroutines with each other
+    m_state->up = up;
+    up->m_state->down = m_state->current;
+}
+
+inline std::coroutine_handle<> Continuation::await_suspend(std::coroutine_handle<> finished) noexcept
+{
+    // `this` lives inside the frame being destroyed
+    CoroutineControllerBase<> *next = up;
+    std::shared_ptr<WaiterList> waiters = std::move(shared);
+
+    /*
+     * coroutine suspended on final_suspend() has nothing left to do, and nobody else
+     * is going to destroy it — result is kept in SharedState, referenced by Async<T>
+     */
+    finished.destroy();
+
+    /*
+     * one by one, so waiters aborted by previously resumed ones are skipped
+     * (their awaiters unlink themselves)
+     */
+    if (waiters) {
+        while (WaiterNode *waiter = waiters->pop_front()) {
+            waiter->handle.resume();
+        }
+    }
+
+    if (next) {
+        return next->make_handle();
+    }
+
+    return std::noop_coroutine();
+}
+
+// =============================================================================
+
+/*
+ * result of one coroutine, awaited by any number of coroutines (of the same thread)
+ *
+ *   SharedAsync<QImage> thumbnail = loader->render(path);
+ *   ...
+ *   const QImage &image = co_await thumbnail;   // in as many coroutines as needed
+ *
+ * every waiter gets const reference to the single result (valid while SharedAsync is alive),
+ * all of them are resumed one after another once shared coroutine finishes,
+ * all of them are aborted if it's aborted
+ *
+ * aborting a waiter doesn't affect the rest, but once the last waiter is gone
+ * before result is ready, shared coroutine is aborted too — nobody needs it anymore
+ *
+ * Async<T> passed in shouldn't be `co_await`-ed directly
+ */
+template<typename T>
+struct SharedAsync
+{
+    SharedAsync(Async<T> async)
+        : m_state(std::move(async.m_state))
+    {
+        Q_ASSERT(!m_state->up);
+        if (!m_state->shared) {
+            m_state->shared = std::make_shared<WaiterList>();
+        }
+    }
+
+    bool isReady() const
+    {
+        return m_state->result.has_value();
+    }
+
+    std::shared_ptr<SharedState<T>> m_state;
+};
+
+template<typename T>
+struct SharedAsyncAwaiter : WaiterNode
+{
+    SharedAsyncAwaiter(std::shared_ptr<SharedState<T>> state)
+        : m_state(std::move(state))
+    {}
+
+    SharedAsyncAwaiter(SharedAsyncAwaiter &&other)
+        : WaiterNode()
+        , m_state(std::move(other.m_state))
+    {
+        // may be moved around only before being linked
+        Q_ASSERT(!other.linked);
+    }
+
+    ~SharedAsyncAwaiter()
+    {
+        if (!linked) {
+            return;
+        }
+
+        // waiting coroutine is being aborted
+        m_state->shared->remove(this);
+        if (m_state->shared->empty() && m_state->current && !m_state->result) {
+#ifdef COSIGNAL_DEBUG
+            qDebug() << "aborting shared coroutine because its' last waiter was aborted";
+#endif
+            m_state->current->abort(AbortReason::Unwound);
+        }
+    }
+
+    bool await_ready() const
+    {
+        return m_state->result.has_value();
+    }
+
+    void await_suspend(std::coroutine_handle<> untypedHandle)
+    {
+        Handle& handle = reinterpret_cast<Handle&>(untypedHandle);
+
+        if (!m_state->current) {
+            // shared coroutine was aborted already, there will be no result
+#ifdef COSIGNAL_DEBUG
+            qDebug() << "aborting coroutine awaiting on shared one because shared was aborted";
+#endif
+            handle.promise().abort(AbortReason::Unwound);
+            return;
+        }
+
+        // waiters are resumed right from shared coroutine's final_suspend()
+        Q_ASSERT(handle.promise().m_object->thread() == m_state->current->m_object->thread());
+
+        this->handle = untypedHandle;
+        m_state->shared->push_back(this);
+    }
+
+    decltype(auto) await_resume() const
+    {
+        if constexpr (std::is_void_v<T>) {
+            return;
+        } else {
+            return static_cast<const T&>(*m_state->result);
+        }
+    }
+
+private:
+    std::shared_ptr<SharedState<T>> m_state;
+};
+
+// =============================================================================
+
+/*
+ * per-thread queue of coroutines yielding to the event loop (see yieldNow())
+ *
+ * a single queued invocation per batch of yields, so yielding itself allocates nothing
+ * (except for Qt's own bookkeeping of the invocation)
+ */
+class YieldQueue
+{
+public:
+    static YieldQueue &local()
+    {
+        thread_local YieldQueue queue;
+        return queue;
+    }
+
+    static qint64 now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count();
+    }
+
+    YieldQueue(const YieldQueue &) = delete;
+    YieldQueue &operator=(const YieldQueue &) = delete;
+
+    const std::shared_ptr<RegistryLock> &lock() const
+    {
+        return m_lock;
+    }
+
+    void push(WaiterNode *waiter)
+    {
+        {
+            std::lock_guard guard(m_lock->mutex);
+            m_waiters.push_back(waiter);
+        }
+        if (!m_scheduled) {
+            m_scheduled = true;
+            // behind everything posted so far
+            QMetaObject::invokeMethod(&m_context, [this] { resume(); }, Qt::QueuedConnection);
+        }
+    }
+
+    /*
+     * from any thread — coroutine may be aborted in the thread its' owner was moved to
+     */
+    static void remove(const std::shared_ptr<RegistryLock> &lock, YieldQueue *queue, WaiterNode *waiter)
+    {
+        std::lock_guard guard(lock->mutex);
+        // otherwise it was already resumed (or queue is gone and has unlinked everything)
+        if (waiter->linked) {
+            queue->m_waiters.remove(waiter);
+        }
+    }
+
+    /*
+     * since when current coroutine is running without giving control back to the event loop:
+     * since it was resumed after yielding or since event loop has last woken up, whichever is later
+     */
+    qint64 sliceStart() const
+    {
+        return m_sliceStart;
+    }
+
+    /*
+     * picks which of `count` coroutines left in the batch is resumed next, in order of yielding if not set
+     * (VirtualTimeDispatcher sets it, so coroutines resumed within the same pass are shuffled)
+     */
+    using Picker = quint32 (*)(quint32 count);
+
+    static Picker &picker()
+    {
+        static thread_local Picker value = nullptr;
+        return value;
+    }
+
+private:
+    YieldQueue()
+        : m_sliceStart(now())
+        , m_lock(std::make_shared<RegistryLock>())
+    {
+        m_lock->context = &m_context;
+        if (QAbstractEventDispatcher *dispatcher = QAbstractEventDispatcher::instance()) {
+            QObject::connect(dispatcher, &QAbstractEventDispatcher::awake, &m_context, [this] {
+                m_sliceStart = now();
+            });
+        }
+    }
+
+    ~YieldQueue()
+    {
+        // thread is exiting, coroutines of owners moved elsewhere are still resumed there
+        std::lock_guard guard(m_lock->mutex);
+        m_lock->context = nullptr;
+        while (WaiterNode *waiter = m_waiters.pop_front()) {
+            if (!waiter->handle) {
+                continue;
+            }
+            std::coroutine_handle<CoroutineControllerBase<>>::from_address(waiter->handle.address())
+                .promise().post_resume_if_moved();
+        }
+    }
+
+    void resume()
+    {
+        m_scheduled = false;
+
+        /*
+         * only coroutines yielded before this batch started, the ones yielding again
+         * (or for the first time) while it's resumed go to the next one, behind pending events
+         * (aborted waiters unlink themselves, marker never is)
+         */
+        WaiterNode end;
+        std::unique_lock guard(m_lock->mutex);
+        m_waiters.push_back(&end);
+        while (WaiterNode *waiter = next(&end)) {
+            if (waiter == &end) {
+                break;
+            }
+            if (!waiter->handle) {
+                // marker of outer batch, when resumed coroutine runs nested event loop
+                continue;
+            }
+            if (std::coroutine_handle<CoroutineControllerBase<>>::from_address(waiter->handle.address())
+                    .promise().post_resume_if_moved()) {
+                continue;
+            }
+            // owner is in this thread, so nobody else can abort the coroutine now
+            guard.unlock();
+            m_sliceStart = now();
+            waiter->handle.resume();
+            guard.lock();
+        }
+    }
+
+    // under the lock
+    WaiterNode *next(WaiterNode *end)
+    {
+        Picker pick = picker();
+        if (!pick || m_waiters.first == end) {
+            return m_waiters.pop_front();
+        }
+
+        quint32 count = 0;
+        for (WaiterNode *waiter = m_waiters.first; waiter != end; waiter = waiter->next) {
+            ++count;
+        }
+        WaiterNode *waiter = m_waiters.first;
+        for (quint32 skip = pick(count); skip > 0; --skip) {
+            waiter = waiter->next;
+        }
+        m_waiters.remove(waiter);
+        return waiter;
+    }
+
+    WaiterList m_waiters;
+    bool m_scheduled = false;
+    qint64 m_sliceStart;
+    const std::shared_ptr<RegistryLock> m_lock;
+    QObject m_context;
+};
+
+/*
+ * `co_await yieldNow()` — resume after events pending in the event loop are processed
+ * `co_await yieldIfNeeded(budget)` — the same, but only once coroutine (and whatever ran before it
+ * in the same event loop pass) has been running longer than `budget`, otherwise just one clock read
+ *
+ *   for (const Item &item : items) {
+ *       process(item);
+ *       co_await yieldIfNeeded(std::chrono::milliseconds(8));
+ *   }
+ *
+ * lets long loops in GUI thread keep frames short without going to a pool thread
+ */
+struct YieldToEventLoop : WaiterNode
+{
+    ~YieldToEventLoop()
+    {
+        // coroutine aborted while (or after) yielding
+        if (lock) {
+            YieldQueue::remove(lock, queue, this);
+        }
+    }
+
+    bool await_ready() const
+    {
+        return budget >= 0 && YieldQueue::now() - YieldQueue::local().sliceStart() < budget;
+    }
+
+    void await_suspend(std::coroutine_handle<> untypedHandle)
+    {
+        handle = untypedHandle;
+        queue = &YieldQueue::local();
+        lock = queue->lock();
+        queue->push(this);
+    }
+
+    void await_resume() {}
+
+    // nanoseconds, negative — yield unconditionally
+    qint64 budget;
+    // of the thread coroutine has yielded in, owner may be moved elsewhere since
+    YieldQueue *queue = nullptr;
+    std::shared_ptr<RegistryLock> lock = nullptr;
+};
+
+inline YieldToEventLoop yieldNow()
+{
+    return YieldToEventLoop{{}, -1};
+}
+
+inline YieldToEventLoop yieldIfNeeded(std::chrono::nanoseconds budget = std::chrono::milliseconds(8))
+{
+    return YieldToEventLoop{{}, budget.count()};
+}
+
+/*
+ * concept for Q_OBJECT
+ * humbly copied from qcoro
+ */
+template<typename T>
+concept QObjectConcept = requires(T *obj) {
+    requires std::is_base_of_v<QObject, T>;
+    requires std::is_same_v<decltype(T::staticMetaObject), const QMetaObject>;
+};
+
+/*
+ * indicating to the compiler, that methods of the form
+ *
+ *   Async<T> C::foo(Args...)
+ *
+ * should be treated as coroutines and controlled by CoroutineController<T>
+ *
+ * in theory it may also catch
+ *
+ *   Async<T> foo(C& c, Args...)
+ *
+ * Also
+ *
+ *   Async<T> C::foo(Args...) const
+ *
+ * not supported, because
+ *
+ *   co_await QFuture<X>().then(this, [] ...
+ *
+ * requires `this` to not be const ¯\_(ツ)_/¯
+ */
+template<typename T, QObjectConcept C, typename... Args>
+struct std::coroutine_traits<Async<T>, C&, Args...>
+{
+    using promise_type = CoroutineController<T>;
+};
+
+// =============================================================================
+
+template<typename T>
+struct GeneratorController;
+
+/*
+ * lazy sequence of values, produced by coroutine with `co_yield`
+ *
+ *   AsyncGenerator<int> Class::numbers()
+ *   {
+ *     for (int i = 0; i < 3; ++i) {
+ *       co_await CoSignal(...);
+ *       co_yield i;
+ *     }
+ *   }
+ *
+ *   AsyncGenerator<int> gen = numbers();
+ *   while (std::optional<int> i = co_await gen.next()) {
+ *     ...
+ *   }
+ *
+ * body doesn't start until first `next()` and runs only while consumer awaits
+ * next value, consumer is linked to generator exactly like to awaited Async<T>,
+ * so aborting either of them aborts the other one
+ *
+ * generator is also aborted when its' last AsyncGenerator object is destroyed
+ * before sequence was exhausted
+ */
+template<typename T>
+struct AsyncGenerator
+{
+    static_assert(!std::is_void_v<T>, "generator of nothing");
 
-        if (up) {
+    struct NextAwaiter
+    {
+        using value_type = T;
+
+        SharedState<T> *state;
+
+        bool await_ready() const
+        {
+            // exhausted, aborted one is handled in `await_suspend()`
+            return !state->current && !state->aborted;
+        }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> untypedHandle)
+        {
+            // same assumptions as in Async<T>::await_suspend()
+            Handle& handle = reinterpret_cast<Handle&>(untypedHandle);
+            CoroutineController<> *up = &handle.promise();
+
+            if (state->aborted) {
+                // e.g. its' owner was destroyed between `next()`-s, sequence didn't really end
 #ifdef COSIGNAL_DEBUG
-            qDebug() << "aborting upstack coroutine because current was aborted";
+                qDebug() << "aborting generator's consumer because generator was aborted";
 #endif
-            up->abort();
+                up->abort(AbortReason::Unwound);
+                return std::noop_coroutine();
+            }
+
+            // it isn't being `co_await`-ed by somebody else already
+            Q_ASSERT(!state->up);
+
+            // both coroutines resides in the same thread
+            Q_ASSERT(up->m_object->thread() == state->current->m_object->thread());
+
+            state->up = up;
+            up->m_state->down = state->current;
+
+            return state->current->make_handle();
         }
+
+        std::optional<T> await_resume()
+        {
+            // empty when generator has finished instead of yielding
+            std::optional<T> value = std::move(state->result);
+            state->result.reset();
+            return value;
+        }
+    };
+
+    AsyncGenerator(std::shared_ptr<SharedState<T>> state)
+        : m_state(state)
+    {}
+
+    AsyncGenerator(AsyncGenerator &&) = default;
+
+    AsyncGenerator &operator=(AsyncGenerator &&other)
+    {
+        if (this != &other) {
+            // replaced one is abandoned just as if it was destroyed
+            abandon();
+            m_state = std::move(other.m_state);
+        }
+        return *this;
     }
 
-    inline Async<T> get_return_object() noexcept { return Async<T>(m_state); }
+    ~AsyncGenerator()
+    {
+        abandon();
+    }
 
-    inline static std::suspend_never initial_suspend() noexcept { return {}; }
+    NextAwaiter next()
+    {
+        return { m_state.get() };
+    }
 
-    inline Continuation final_suspend() noexcept
+    std::shared_ptr<SharedState<T>> m_state;
+
+private:
+    void abandon()
+    {
+        // suspended on `co_yield` (or never started) and nobody is going to resume it
+        if (m_state && m_state->current && !m_state->up) {
+#ifdef COSIGNAL_DEBUG
+            qDebug() << "aborting generator because it was abandoned";
+#endif
+            m_state->current->abort(AbortReason::Other);
+        }
+    }
+};
+
+/*
+ * returned from `yield_value()` — hands control back to the consumer
+ */
+struct YieldAwaiter
+{
+    CoroutineControllerBase<> *current;
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<>) noexcept
+    {
+        CoroutineControllerBase<> *up = current->m_state->up;
+        Q_ASSERT(up);
+
+        // consumer will link itself again on next `next()`
+        up->m_state->down = nullptr;
+        current->m_state->up = nullptr;
+
+        return up->make_handle();
+    }
+
+    void await_resume() noexcept {}
+};
+
+template<typename T>
+struct GeneratorController : CoroutineControllerBase<T>
+{
+    template<typename... Args>
+    GeneratorController(QObject &object, Args...)
+        : CoroutineControllerBase<T>(object)
+    {
+        // suspended right away
+        this->watch_owner();
+    }
+
+    inline AsyncGenerator<T> get_return_object() noexcept { return AsyncGenerator<T>(this->m_state); }
+
+    // lazy, runs only on demand
+    inline static std::suspend_always initial_suspend() noexcept { return {}; }
+
+    inline YieldAwaiter yield_value(T&& v) noexcept
+    {
+        this->m_state->result.emplace(std::forward<T>(v));
+        return { reinterpret_cast<CoroutineControllerBase<>*>(this) };
+    }
+
+    inline YieldAwaiter yield_value(const T& v) noexcept
+    {
+        this->m_state->result.emplace(v);
+        return { reinterpret_cast<CoroutineControllerBase<>*>(this) };
+    }
+
+    inline void return_void() noexcept {}
+};
+
+/*
+ * same as for Async<T>, but for generators
+ */
+template<typename T, QObjectConcept C, typename... Args>
+struct std::coroutine_traits<AsyncGenerator<T>, C&, Args...>
+{
+    using promise_type = GeneratorController<T>;
+};
+
+enum CoSignalFlags
+{
+    SingleShot = 1,
+    DeleteSenderOnSignal = 2,
+
+    /*
+     * modes for signals emitted way more often than coroutine cares about (progress, sensors, etc.)
+     * emissions are only recorded in the slot, coroutine is resumed with the latest args:
+     *
+     * - once per event loop pass (Coalesce)
+     * - after `interval` ms without emissions (Debounce)
+     * - at most once per `interval` ms (Throttle)
+     *
+     * all of them are meant for `co_await`-ing the same CoSignal in a loop, not together with SingleShot
+     */
+    Coalesce = 4,
+    Debounce = 8,
+    Throttle = 16,
+
+    // every emission since previous resume is kept, see `CoSignal::batch()`
+    Batch = 32,
+
+    /*
+     * for senders living in another thread: instead of queued connection (args copied into
+     * heap-allocated event, then copied again into CoSignal) slot is run right in the emitting
+     * thread, copies args once into preallocated slot of the awaiter and posts a single
+     * lightweight wake-up event (one per any number of emissions before owner's thread wakes up)
+     *
+     * slot holds only the latest emission, so not to be combined with Batch or DeleteSenderOnSignal
+     */
+    CrossThread = 64,
+};
+
+inline CoSignalFlags operator|(CoSignalFlags a, CoSignalFlags b)
+{
+    return CoSignalFlags(int(a) | int(b));
+}
+
+/*
+ * support for `co_await`-ing Qt signals
+ * aborts coroutine if sender is destroyed when awaiting
+ *
+ * without SingleShot connection stays alive between `co_await`-s,
+ * emission received while coroutine is busy elsewhere is returned by the next `co_await`
+ */
+template <QObjectConcept T, QObjectConcept F, typename... Args>
+requires std::is_base_of_v<F, T>
+struct CoSignal
+{
+    // signal arguments are stored by value, even for `const T&` parameters
+    using Result = std::tuple<std::decay_t<Args>...>;
+
+    CoSignal(T* sender, void(F::*signal)(Args...), CoSignalFlags flags = CoSignalFlags::SingleShot, int interval = 0)
+        : m_sender(sender)
+        , m_signal(signal)
+        , m_flags(flags)
+        , m_interval(interval)
+        , m_received(false)
+    {}
+
+    ~CoSignal()
     {
         QObject::disconnect(m_connection);
-        m_state->current = nullptr;
+        QObject::disconnect(m_destroyedConnection);
+        delete m_timer;
+
+        if (m_handoff) {
+            {
+                // slot may be running in the sender's thread right now
+                std::lock_guard lock(m_handoff->mutex);
+                m_handoff->waker = nullptr;
+            }
+            // may be inside of waker's `event()` at this very moment
+            if (m_waker->delivering) {
+                m_waker->awaiter = nullptr;
+                m_waker->deleteLater();
+            } else {
+                // pending wake-up (if any) is discarded along with it
+                delete m_waker;
+            }
+        }
+    }
+
+    bool await_ready()
+    {
+        m_reportErrors = false;
+        return m_received || m_due;
+    }
 
+    void await_suspend(std::coroutine_handle<> untypedHandle)
+    {
         /*
-         * if there is another coroutine, awaiting on `this` — it will be awoken
-         * after this one was destroyed
+         * also assuming `this` is `co_await`-ed by CoroutineController<X>
          */
-        Continuation next = { m_state->up };
+        Handle& handle = reinterpret_cast<Handle&>(untypedHandle);
+        m_handle = handle;
 
-        if (m_state->up) {
-            Q_ASSERT(reinterpret_cast<CoroutineControllerBase*>(m_state->up->m_state->down) == this);
-            m_state->up->m_state->down = nullptr;
-            m_state->up = nullptr;
+        if (!m_sender) {
+            // was destroyed earlier, while `tryAwait()`-ing or being busy elsewhere
+            handle_sender_destroyed();
+            return;
+        }
+
+        if (!m_connection) {
+            Q_ASSERT(m_sender);
+
+            // `m_received == true` means `await_ready()` should've returned `true`
+            // and this method should not have been called
+            Q_ASSERT(!m_received);
+
+            if (m_flags & CoSignalFlags::CrossThread) {
+                connect_cross_thread();
+            } else {
+                m_destroyedConnection = QObject::connect(
+                    m_sender,
+                    &QObject::destroyed,
+                    handle.promise().m_object,
+                    [this] { this->handle_sender_destroyed(); }
+                );
+            }
+
+            /*
+             * everything the modes need is allocated right here, once — emissions only fill it in:
+             * timer is restarted rather than recreated (child of the owner, so it's moved
+             * to another thread along with it), batch buffers are swapped rather than reallocated
+             */
+            if (m_flags & CoSignalFlags::Batch) {
+                m_batch.reserve(m_batchCapacity);
+                m_delivered.reserve(m_batchCapacity);
+            }
+            if (m_flags & (CoSignalFlags::Coalesce | CoSignalFlags::Debounce | CoSignalFlags::Throttle)) {
+                m_timer = new QTimer(handle.promise().m_object);
+                m_timer->setSingleShot(true);
+                QObject::connect(m_timer, &QTimer::timeout, [this] { this->handle_timeout(); });
+            }
+
+            if (!m_connection) {
+                m_connection = QObject::connect(
+                    m_sender,
+                    m_signal,
+                    handle.promise().m_object,
+                    [this](Args... args) {
+                        if (this->m_flags & CoSignalFlags::Batch) {
+                            this->m_batch.emplace_back(args...);
+                        }
+                        this->m_result = {args...};
+                        this->handle_signal();
+                    },
+                    (m_flags & CoSignalFlags::SingleShot) ? Qt::SingleShotConnection : Qt::AutoConnection
+                );
+            }
+        }
+
+        m_received = false;
+        m_suspended = true;
+    }
+
+    void handle_signal()
+    {
+        if (m_flags & CoSignalFlags::SingleShot) {
+            QObject::disconnect(m_destroyedConnection);
+            m_received = true;
+        }
+        if (m_flags & CoSignalFlags::DeleteSenderOnSignal) {
+            QObject::disconnect(m_destroyedConnection);
+            delete m_sender;
+        }
+
+#ifdef COSIGNAL_METRICS
+        // latency is counted from the oldest emission not returned yet
+        // (CrossThread ones are stamped in sender's thread, see `handle_handoff()`)
+        if (!m_pending && !(m_flags & CoSignalFlags::CrossThread)) {
+            m_emittedAt = CoroutineMetrics::now();
+        }
+#endif
+        m_pending = true;
+
+        // coalescing happens right here — no resumes, only (re)starting the timer
+        if (m_flags & CoSignalFlags::Debounce) {
+            m_timer->start(m_interval);
+            return;
+        }
+        if (m_flags & CoSignalFlags::Coalesce) {
+            if (!m_timer->isActive()) {
+                m_timer->start(0);
+            }
+            return;
+        }
+        if ((m_flags & CoSignalFlags::Throttle) && m_timer->isActive()) {
+            // cooling down since last resume
+            return;
+        }
+
+        m_due = true;
+        resume_if_suspended();
+    }
+
+    void handle_sender_destroyed()
+    {
+        m_sender = nullptr;
+        if (m_reportErrors) {
+#ifdef COSIGNAL_DEBUG
+            qDebug() << "resuming coroutine awaiting on signal with an error because expected sender was destroyed";
+#endif
+            // if not suspended right now, next `co_await` reports it
+            resume_if_suspended();
+            return;
+        }
+
+#ifdef COSIGNAL_DEBUG
+        qDebug() << "aborting coroutine awaiting on signal because expected sender was destroyed";
+#endif
+        m_handle.promise().abort(AbortReason::SenderDestroyed);
+    }
+
+    void handle_timeout()
+    {
+        if (!m_pending) {
+            // throttle cooldown has passed quietly
+            return;
+        }
+
+        m_due = true;
+        resume_if_suspended();
+    }
+
+    void resume_if_suspended()
+    {
+        if (m_suspended) {
+            m_suspended = false;
+            m_handle.resume();
+        }
+    }
+
+    /*
+     * can be optimized for `Args = {void}` and `Args = {T}` cases along with `m_result`
+     * via some glorious SFINAE magic, but good enough for demonstration
+     */
+    Result await_resume()
+    {
+#ifdef COSIGNAL_METRICS
+        if (m_pending) {
+            CoroutineMetrics::signalResumed(m_emittedAt);
+        }
+#endif
+        m_suspended = false;
+        m_due = false;
+        m_pending = false;
+
+        if (m_flags & CoSignalFlags::Batch) {
+            // buffers are swapped, not reallocated
+            std::swap(m_batch, m_delivered);
+            m_batch.clear();
+        }
+        if (m_flags & CoSignalFlags::Throttle) {
+            m_timer->start(m_interval);
+        }
+
+        if (m_flags & CoSignalFlags::CrossThread) {
+            // nobody else needs it, so no second copy
+            return std::move(m_result);
+        }
+        return m_result;
+    }
+
+    /*
+     * tryAwait() support: destroyed sender resumes coroutine with an error instead of aborting it
+     * (plain `co_await` of the same CoSignal switches back to aborting)
+     */
+    bool try_await_ready()
+    {
+        m_reportErrors = true;
+        return m_received || m_due || !m_sender;
+    }
+
+    Expected<Result> try_await_resume()
+    {
+        // emission received before destruction is returned first
+        if (!m_sender && !m_pending && !m_received) {
+            return Unexpected{AwaitError::SenderDestroyed};
+        }
+        return await_resume();
+    }
+
+    /*
+     * with Batch — room for `capacity` emissions between `co_await`-s, allocated on the first `co_await`
+     * (so has to be called before it), longer burst grows buffer once and its' capacity is kept since
+     */
+    void reserveBatch(qsizetype capacity)
+    {
+        m_batchCapacity = capacity;
+    }
+
+    /*
+     * with Batch — args of every emission delivered by the last `co_await`, oldest first
+     * valid until the next `co_await` on this CoSignal
+     */
+    const std::vector<Result> &batch() const
+    {
+        return m_delivered;
+    }
+
+private:
+    template<typename... Signals>
+    friend struct AnyOf;
+
+    static QEvent::Type wakeEventType()
+    {
+        static const QEvent::Type type = QEvent::Type(QEvent::registerEventType());
+        return type;
+    }
+
+    /*
+     * CrossThread: shared between the awaiter (owner's thread) and the slot (sender's thread),
+     * lives until both of them are gone
+     */
+    struct Handoff
+    {
+        // under `mutex`
+        void wake()
+        {
+            if (!posted) {
+                posted = true;
+                QCoreApplication::postEvent(waker, new QEvent(wakeEventType()));
+            }
+        }
+
+        std::mutex mutex;
+        Result value;
+        bool full = false;
+#ifdef COSIGNAL_METRICS
+        // oldest emission in `value` not taken by the awaiter yet
+        qint64 emittedAt = 0;
+#endif
+        bool senderDestroyed = false;
+        // wake-up event is on its' way
+        bool posted = false;
+        // nulled by CoSignal's destructor, nothing is posted after that
+        QObject *waker = nullptr;
+    };
+
+    /*
+     * receiver of wake-up events in owner's thread
+     */
+    struct Waker : QObject
+    {
+        bool event(QEvent *event) override
+        {
+            if (event->type() != wakeEventType()) {
+                return QObject::event(event);
+            }
+            if (awaiter) {
+                delivering = true;
+                awaiter->handle_handoff(this);
+                delivering = false;
+            }
+            return true;
         }
 
-        return next;
+        CoSignal *awaiter = nullptr;
+        bool delivering = false;
+    };
+
+    void connect_cross_thread()
+    {
+        Q_ASSERT(!(m_flags & (CoSignalFlags::Batch | CoSignalFlags::DeleteSenderOnSignal)));
+
+        // follows the owner into another thread, like the timer
+        m_waker = new Waker();
+        m_waker->setParent(m_handle.promise().m_object);
+        m_waker->awaiter = this;
+        m_handoff = std::make_shared<Handoff>();
+        m_handoff->waker = m_waker;
+
+        // sender itself is the context, so both slots are run in sender's thread
+        m_destroyedConnection = QObject::connect(
+            m_sender,
+            &QObject::destroyed,
+            m_sender,
+            [handoff = m_handoff] {
+                std::lock_guard lock(handoff->mutex);
+                if (handoff->waker) {
+                    handoff->senderDestroyed = true;
+                    handoff->wake();
+                }
+            },
+            Qt::DirectConnection
+        );
+
+        m_connection = QObject::connect(
+            m_sender,
+            m_signal,
+            m_sender,
+            [handoff = m_handoff](const std::decay_t<Args> &...args) {
+                std::lock_guard lock(handoff->mutex);
+                if (handoff->waker) {
+#ifdef COSIGNAL_METRICS
+                    // so hop into owner's thread counts too
+                    if (!handoff->full) {
+                        handoff->emittedAt = CoroutineMetrics::now();
+                    }
+#endif
+                    // the only copy, into already existing values
+                    handoff->value = std::tie(args...);
+                    handoff->full = true;
+                    handoff->wake();
+                }
+            },
+            Qt::ConnectionType(Qt::DirectConnection | ((m_flags & CoSignalFlags::SingleShot) ? Qt::SingleShotConnection : 0))
+        );
     }
 
-    inline static void unhandled_exception() noexcept
+    void handle_handoff(Waker *waker)
     {
-        Q_ASSERT_X(false, __PRETTY_FUNCTION__, "not supported");
-        std::abort();
-    }
+        bool full;
+        bool senderDestroyed;
+        {
+            std::lock_guard lock(m_handoff->mutex);
+            m_handoff->posted = false;
+            full = std::exchange(m_handoff->full, false);
+            senderDestroyed = m_handoff->senderDestroyed;
+            if (full) {
+                // buffers are swapped back and forth, not reallocated
+                std::swap(m_result, m_handoff->value);
+#ifdef COSIGNAL_METRICS
+                if (!m_pending) {
+                    m_emittedAt = m_handoff->emittedAt;
+                }
+#endif
+            }
+        }
 
-    template <typename A>
-    inline static A&& await_transform(A&& someAsync)
-    {
-        // CoSignal<> and Async<> cases
-        return std::move(someAsync);
-    }
+        if (full) {
+            // may resume coroutine and destroy `this`, `waker` is deleted later
+            handle_signal();
+        }
 
-    template<typename K>
-    FutureAwaiter<K> await_transform(QFuture<K> future)
-    {
-        return FutureAwaiter<K>(future, m_object);
+        if (senderDestroyed && waker->awaiter && !waker->awaiter->m_received) {
+            waker->awaiter->handle_sender_destroyed();
+        }
     }
 
-    QObject *const m_object;
+    QPointer<T> m_sender;
+    void (F::*m_signal)(Args...);
+    CoSignalFlags m_flags;
+    int m_interval;
+    bool m_received;
+
+    // coroutine is suspended on this CoSignal right now
+    bool m_suspended = false;
+    // emission received, but not returned by `co_await` yet
+    bool m_pending = false;
+    // last `co_await` was via tryAwait()
+    bool m_reportErrors = false;
+    // pending emission should be returned by the next `co_await`
+    bool m_due = false;
+#ifdef COSIGNAL_METRICS
+    qint64 m_emittedAt = 0;
+#endif
+
+    Handle m_handle;
+
     QMetaObject::Connection m_connection;
-    const std::shared_ptr<SharedState<T>> m_state;
+    QMetaObject::Connection m_destroyedConnection;
+
+    // created on first `co_await`, so copying not yet awaited CoSignal is fine
+    QTimer *m_timer = nullptr;
+
+    // CrossThread
+    std::shared_ptr<Handoff> m_handoff;
+    Waker *m_waker = nullptr;
+
+    Result m_result;
+    std::vector<Result> m_batch;
+    std::vector<Result> m_delivered;
+    qsizetype m_batchCapacity = 64;
 };
 
 /*
- * "specialization" of coroutine controller for generic case and `T = void`
+ * `co_await`-ing whichever of several signals comes first
  *
- * it's strange and funny how such inheritance scheme is basically required,
- * because compiler forbids  simultaneous presence of both `return_value()` and `return_void()`
- * even when they are hidden under SFINAE
+ *   auto result = co_await anyOf(
+ *       CoSignal(process, &QProcess::finished),
+ *       CoSignal(process, &QProcess::errorOccurred),
+ *       CoSignal(cancelButton, &QPushButton::clicked)
+ *   );
+ *   if (result.index() == 0) {
+ *       auto [exitCode, exitStatus] = std::get<0>(result);
+ *   }
+ *
+ * returns `std::variant` of argument tuples, one alternative per signal in the same order
+ * CoSignal-s are used only as descriptions, of flags only DeleteSenderOnSignal is honored
+ *
+ * connections are kept in fixed array inside coroutine frame, so nothing is allocated per signal
+ * (except for Qt's own connection bookkeeping), and all of them are dropped as soon as
+ * the first signal arrives
+ * aborts coroutine once all the senders are destroyed
  */
-template<typename T>
-struct CoroutineController : CoroutineControllerBase<T>
+template<typename... Signals>
+struct AnyOf
 {
-#ifdef COSIGNAL_DEBUG
-    // required only if there is `virtual ~CoroutineControllerBase()`
-    template<typename... Args>
-    CoroutineController(QObject &object, Args...)
-        : CoroutineControllerBase<T>(object)
+    using Result = std::variant<decltype(std::declval<Signals&>().await_resume())...>;
+
+    AnyOf(Signals... awaitables)
+        : m_signals(std::move(awaitables)...)
     {}
-#endif
 
-    inline void return_value(T&& v) noexcept
+    ~AnyOf()
     {
-        this->m_state->result.emplace(std::forward<T>(v));
+        disconnect_all();
     }
 
-    inline void return_value(T& v) noexcept
+    bool await_ready()
     {
-        this->m_state->result.emplace(v);
+        m_reportErrors = false;
+        return m_result.has_value();
     }
-};
 
-template<>
-struct CoroutineController<void> : CoroutineControllerBase<void>
-{
-#ifdef COSIGNAL_DEBUG
-    // required only if there is `virtual ~CoroutineControllerBase()`
-    template<typename... Args>
-    CoroutineController(QObject &object, Args...)
-        : CoroutineControllerBase<void>(object)
-    {}
+    void await_suspend(std::coroutine_handle<> untypedHandle)
+    {
+        // same assumption as in CoSignal
+        m_handle = reinterpret_cast<Handle&>(untypedHandle);
+
+        [&]<std::size_t... I>(std::index_sequence<I...>) {
+            (connect_one<I>(std::get<I>(m_signals)), ...);
+        }(std::index_sequence_for<Signals...>{});
+    }
+
+    Result await_resume()
+    {
+#ifdef COSIGNAL_METRICS
+        if (m_emittedAt) {
+            CoroutineMetrics::signalResumed(m_emittedAt);
+        }
 #endif
+        return std::move(*m_result);
+    }
 
-    inline void return_void() noexcept
+    // tryAwait() support, destroyed senders resume coroutine with an error instead of aborting it
+    bool try_await_ready()
     {
-        m_state->result.emplace(true);
+        m_reportErrors = true;
+        const bool anyAlive = std::apply([](auto &...signal) { return (bool(signal.m_sender) || ...); }, m_signals);
+        return m_result.has_value() || !anyAlive;
     }
-};
 
-/*
- * `co_await`-ing on another coroutine (referenced by `untypedHandle`)
- */
-template<typename T>
-void Async<T>::await_suspend(std::coroutine_handle<> untypedHandle)
-{
-    /*
-     * we assume that `this` is being `co_await`-ed by another Async<X> coroutine
-     *
-     * mixing different coroutine types in single app is like replacing shotgun
-     * aimed at your foot with gatling gun — good luck
-     */
-    Handle& handle = reinterpret_cast<Handle&>(untypedHandle);
-    CoroutineController<> *up = &handle.promise();
+    Expected<Result> try_await_resume()
+    {
+        if (!m_result) {
+            return Unexpected{AwaitError::SenderDestroyed};
+        }
+        return await_resume();
+    }
 
-    // sanity checks
+private:
+    template<std::size_t I, typename T, typename F, typename... Args>
+    void connect_one(CoSignal<T, F, Args...> &signal)
+    {
+        if (!signal.m_sender) {
+            // already destroyed, only allowed with tryAwait()
+            Q_ASSERT(m_reportErrors);
+            return;
+        }
+        QObject *object = m_handle.promise().m_object;
 
-    // coroutine bound with `this` is still alive
-    Q_ASSERT(m_state->current);
+        ++m_alive;
+        m_connections[2 * I + 1] = QObject::connect(
+            signal.m_sender,
+            &QObject::destroyed,
+            object,
+            [this] {
+                QObject::disconnect(m_connections[2 * I]);
+                QObject::disconnect(m_connections[2 * I + 1]);
+                std::get<I>(m_signals).m_sender = nullptr;
 
-    // it isn't being `co_await`-ed by somebody else already
-    Q_ASSERT(!m_state->up);
+                if (--m_alive == 0) {
+                    if (m_reportErrors) {
+#ifdef COSIGNAL_DEBUG
+                        qDebug() << "resuming coroutine awaiting on any of signals with an error because all senders were destroyed";
+#endif
+                        m_handle.resume();
+                        return;
+                    }
+#ifdef COSIGNAL_DEBUG
+                    qDebug() << "aborting coroutine awaiting on any of signals because all senders were destroyed";
+#endif
+                    m_handle.promise().abort(AbortReason::SenderDestroyed);
+                }
+            }
+        );
 
-    // both coroutines resides in the same thread
-    Q_ASSERT(up->m_object->thread() == m_state->current->m_object->thread());
+        m_connections[2 * I] = QObject::connect(
+            signal.m_sender,
+            signal.m_signal,
+            object,
+            [this](Args... args) {
+#ifdef COSIGNAL_METRICS
+                this->m_emittedAt = CoroutineMetrics::now();
+#endif
+                this->m_result.emplace(std::in_place_index<I>, args...);
+                this->disconnect_all();
 
-    // linking couroutines with each other
-    m_state->up = up;
-    up->m_state->down = m_state->current;
-}
+                auto &signal = std::get<I>(m_signals);
+                if (signal.m_flags & CoSignalFlags::DeleteSenderOnSignal) {
+                    delete signal.m_sender;
+                }
 
-inline std::coroutine_handle<> Continuation::await_suspend(std::coroutine_handle<>) noexcept
-{
-    if (up) {
-        return up->make_handle();
+                this->m_handle.resume();
+            }
+        );
     }
 
-    return std::noop_coroutine();
-}
+    void disconnect_all()
+    {
+        for (QMetaObject::Connection &connection : m_connections) {
+            QObject::disconnect(connection);
+        }
+    }
 
-/*
- * concept for Q_OBJECT
- * humbly copied from qcoro
- */
-template<typename T>
-concept QObjectConcept = requires(T *obj) {
-    requires std::is_base_of_v<QObject, T>;
-    requires std::is_same_v<decltype(T::staticMetaObject), const QMetaObject>;
+    std::tuple<Signals...> m_signals;
+    // signal and `destroyed` connections of each sender
+    std::array<QMetaObject::Connection, 2 * sizeof...(Signals)> m_connections;
+    int m_alive = 0;
+    bool m_reportErrors = false;
+
+    Handle m_handle;
+    std::optional<Result> m_result;
+#ifdef COSIGNAL_METRICS
+    qint64 m_emittedAt = 0;
+#endif
 };
 
+template<typename... Signals>
+requires (sizeof...(Signals) > 0)
+AnyOf<Signals...> anyOf(Signals... awaitables)
+{
+    return AnyOf<Signals...>(std::move(awaitables)...);
+}
+
+// =============================================================================
+
 /*
- * indicating to the compiler, that methods of the form
- *
- *   Async<T> C::foo(Args...)
- *
- * should be treated as coroutines and controlled by CoroutineController<T>
- *
- * in theory it may also catch
- *
- *   Async<T> foo(C& c, Args...)
- *
- * Also
- *
- *   Async<T> C::foo(Args...) const
- *
- * not supported, because
+ * `co_await`-ing without aborting coroutine on failure, returns Expected instead:
  *
- *   co_await QFuture<X>().then(this, [] ...
+ *   Expected<int> result = co_await tryAwait(future);             // AwaitError::Canceled
+ *   Expected<std::tuple<int>> args = co_await tryAwait(signal);   // AwaitError::SenderDestroyed
  *
- * requires `this` to not be const ¯\_(ツ)_/¯
+ * works for QFuture, CoSignal (named ones included) and anyOf()
+ * owner's destruction still aborts coroutine — there is nobody left to handle the error
  */
-template<typename T, QObjectConcept C, typename... Args>
-struct std::coroutine_traits<Async<T>, C&, Args...>
+template<typename A>
+struct TryAwaiter
 {
-    using promise_type = CoroutineController<T>;
-};
+    bool await_ready()
+    {
+        return awaitable.try_await_ready();
+    }
 
-enum CoSignalFlags
-{
-    SingleShot = 1,
-    DeleteSenderOnSignal = 2,
+    template<typename H>
+    decltype(auto) await_suspend(H handle)
+    {
+        return awaitable.await_suspend(handle);
+    }
+
+    auto await_resume()
+    {
+        return awaitable.try_await_resume();
+    }
+
+    // reference for named awaitables
+    A awaitable;
 };
 
 /*
- * support for `co_await`-ing Qt signals
- * aborts coroutine if sender is destroyed when awaiting
+ * QFuture, which is canceled or failed, resumes coroutine too
  */
-template <QObjectConcept T, QObjectConcept F, typename... Args>
-requires std::is_base_of_v<F, T>
-struct CoSignal
+template<typename T>
+struct TryFuture
 {
-    CoSignal(T* sender, void(F::*signal)(Args...), CoSignalFlags flags = CoSignalFlags::SingleShot)
-        : m_sender(sender)
-        , m_signal(signal)
-        , m_flags(flags)
-        , m_received(false)
+    TryFuture(QFuture<T> future)
+        : m_future(future)
     {}
 
-    ~CoSignal()
+    ~TryFuture()
     {
-        QObject::disconnect(m_connection);
-        QObject::disconnect(m_destroyedConnection);
+        // same as in FutureAwaiter
+        if (m_handle) {
+            *m_handle = nullptr;
+        }
     }
 
     bool await_ready() const
     {
-        return m_received;
+        return m_future.isFinished();
     }
 
     void await_suspend(std::coroutine_handle<> untypedHandle)
     {
-        /*
-         * also assuming `this` is `co_await`-ed by CoroutineController<X>
-         */
-        Handle& handle = reinterpret_cast<Handle&>(untypedHandle);
+        // same assumption as in CoSignal
+        QObject *object = reinterpret_cast<Handle&>(untypedHandle).promise().m_object;
 
-        if (!m_connection) {
-            Q_ASSERT(m_sender);
-
-            // `m_received == true` means `await_ready()` should've returned `true`
-            // and this method should not have been called
-            Q_ASSERT(!m_received);
-
-            m_destroyedConnection = QObject::connect(
-                m_sender,
-                &QObject::destroyed,
-                handle.promise().m_object,
-                [this] {
-#ifdef COSIGNAL_DEBUG
-                    qDebug() << "aborting coroutine awaiting on signal because expected sender was destroyed";
-#endif
-                    this->m_sender = nullptr;
-                    this->m_handle.promise().abort();
-                }
-            );
-
-            m_connection = QObject::connect(
-                m_sender,
-                m_signal,
-                handle.promise().m_object,
-                [this](Args... args) {
-                    this->m_result = {args...};
-                    this->handle_signal();
-                },
-                (m_flags & CoSignalFlags::SingleShot) ? Qt::SingleShotConnection : Qt::AutoConnection
-            );
-        }
+        m_handle = std::make_shared<std::coroutine_handle<>>(untypedHandle);
+        auto resume = [handle = m_handle] {
+            if (*handle) {
+                handle->resume();
+            }
+        };
 
-        m_handle = handle;
-        m_received = false;
+        // continuation taking QFuture is run for failed futures too, but skipped for canceled ones
+        m_future
+            .then(object, [resume] (QFuture<T>) { resume(); })
+            .onCanceled(object, resume);
     }
 
-    void handle_signal()
+    Expected<T> await_resume()
     {
-        if (m_flags & CoSignalFlags::SingleShot) {
-            QObject::disconnect(m_destroyedConnection);
-            m_received = true;
+        // failed futures are canceled as well
+        if (m_future.isCanceled()) {
+            return Unexpected{AwaitError::Canceled};
         }
-        if (m_flags & CoSignalFlags::DeleteSenderOnSignal) {
-            QObject::disconnect(m_destroyedConnection);
-            delete m_sender;
+        if constexpr (std::is_void_v<T>) {
+            return {};
+        } else {
+            return m_future.result();
         }
-
-        m_handle.resume();
-    }
-
-    /*
-     * can be optimized for `Args = {void}` and `Args = {T}` cases along with `m_result`
-     * via some glorious SFINAE magic, but good enough for demonstration
-     */
-    std::tuple<Args...> await_resume()
-    {
-        return m_result;
     }
 
 private:
-    QPointer<T> m_sender;
-    void (F::*m_signal)(Args...);
-    CoSignalFlags m_flags;
-    bool m_received;
+    QFuture<T> m_future;
+    std::shared_ptr<std::coroutine_handle<>> m_handle;
+};
 
-    Handle m_handle;
+template<typename A>
+requires requires (std::remove_reference_t<A> &a) { a.try_await_resume(); }
+TryAwaiter<A> tryAwait(A &&awaitable)
+{
+    return TryAwaiter<A>{std::forward<A>(awaitable)};
+}
 
-    QMetaObject::Connection m_connection;
-    QMetaObject::Connection m_destroyedConnection;
+template<typename T>
+TryFuture<T> tryAwait(QFuture<T> future)
+{
+    return TryFuture<T>(future);
+}
+
+#ifdef COSIGNAL_METRICS
+template<QObjectConcept T, QObjectConcept F, typename... Args>
+struct AwaitKindOf<CoSignal<T, F, Args...>>
+{
+    static constexpr AwaitKind value = AwaitKind::Signal;
+};
 
-    std::tuple<Args...> m_result;
+template<typename... Signals>
+struct AwaitKindOf<AnyOf<Signals...>>
+{
+    static constexpr AwaitKind value = AwaitKind::AnyOf;
+};
+
+template<typename T>
+struct AwaitKindOf<Async<T>>
+{
+    static constexpr AwaitKind value = AwaitKind::Coroutine;
+};
+
+template<typename A>
+requires std::is_same_v<A, typename AsyncGenerator<typename A::value_type>::NextAwaiter>
+struct AwaitKindOf<A>
+{
+    static constexpr AwaitKind value = AwaitKind::Generator;
 };
+
+template<typename A>
+struct AwaitKindOf<TryAwaiter<A>>
+{
+    static constexpr AwaitKind value = AwaitKindOf<std::remove_cvref_t<A>>::value;
+};
+
+template<typename T>
+struct AwaitKindOf<TryFuture<T>>
+{
+    static constexpr AwaitKind value = AwaitKind::Future;
+};
+#endif
@@ -0,0 +1,20 @@
+#pragma once
+
+/*
+ * why coroutine is being aborted instead of running to completion (see COSIGNAL_METRICS)
+ *
+ * shared by `qcosignal.hpp` and `qcosignal_metrics.hpp`
+ */
+enum class AbortReason
+{
+    // owning QObject was destroyed
+    OwnerDestroyed,
+    // sender of awaited signal (or awaited device) was destroyed
+    SenderDestroyed,
+    // coroutine linked to this one (awaiting or awaited) was aborted
+    Unwound,
+    // generator abandoned, job or awaited future canceled, etc.
+    Other,
+
+    Count
+};
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <optional>
+
+#include <QCache>
+#include <QDeadlineTimer>
+#include <QHash>
+
+#include "qcosignal.hpp"
+
+/*
+ * single-flight cache of asynchronously loaded values
+ *
+ *   AsyncCache<QString, QImage> m_thumbnails{this, 64 * 1024 * 1024, std::chrono::minutes(5), &imageBytes};
+ *   ...
+ *   QImage image = co_await m_thumbnails.get(path, [] (const QString &path) {
+ *       return QtConcurrent::run(&renderThumbnail, path);
+ *   });
+ *
+ * - concurrent `get()`-s of the same key share one load (via SharedAsync), loader is called once
+ * - loaded values are kept in QCache, evicted least recently used first once total cost
+ *   exceeds `maxCost` (cost of every value is 1, unless `cost` function is given)
+ * - values older than `ttl` are loaded again (zero `ttl` — never expire)
+ *
+ * loader is called with the key and returns QFuture<V> or Async<V>, load itself is
+ * a coroutine bound to `owner` — if it's aborted (owner destroyed, loader's coroutine aborted,
+ * every waiter gone), its' in-flight entry is dropped and next `get()` starts over
+ * failures are up to the loader — e.g. with `V = Expected<T>`
+ *
+ * meant to be a member of `owner` (cache must not outlive it), single thread only
+ */
+template<typename K, typename V>
+struct AsyncCache
+{
+    using Cost = std::function<qsizetype(const V&)>;
+
+    /*
+     * what `get()` returns — cached value right away, or joining (possibly just started) load
+     */
+    struct Lookup
+    {
+        bool await_ready() const
+        {
+            return m_value || m_state->result.has_value();
+        }
+
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            // node of SharedAsync waiters list, must not move once linked
+            m_waiter.emplace(m_state);
+            m_waiter->await_suspend(handle);
+        }
+
+        V await_resume()
+        {
+            if (m_value) {
+                return std::move(*m_value);
+            }
+            return *m_state->result;
+        }
+
+        std::optional<V> m_value;
+        std::shared_ptr<SharedState<V>> m_state;
+        std::optional<SharedAsyncAwaiter<V>> m_waiter;
+    };
+
+    AsyncCache(QObject *owner, qsizetype maxCost, std::chrono::milliseconds ttl = {}, Cost cost = {})
+        : m_owner(owner)
+        , m_ttl(ttl)
+        , m_cost(std::move(cost))
+        , m_values(maxCost)
+    {}
+
+    AsyncCache(const AsyncCache &) = delete;
+
+    ~AsyncCache()
+    {
+        // loads are bound to the owner, which is still (partially) alive
+        while (!m_loading.isEmpty()) {
+            auto it = m_loading.begin();
+            std::shared_ptr<SharedState<V>> state = it->state;
+            m_loading.erase(it);
+            if (state->current) {
+                state->current->abort(AbortReason::Other);
+            }
+        }
+    }
+
+    template<typename Loader>
+    Lookup get(const K &key, Loader loader)
+    {
+        if (Entry *entry = m_values.object(key)) {
+            if (!entry->expires.hasExpired()) {
+                return Lookup{entry->value, nullptr, std::nullopt};
+            }
+            m_values.remove(key);
+        }
+
+        auto loading = m_loading.find(key);
+        if (loading != m_loading.end()) {
+            return Lookup{std::nullopt, loading->state, std::nullopt};
+        }
+
+        const quint64 generation = ++m_generation;
+        m_starting = generation;
+        SharedAsync<V> shared = load(*m_owner, this, key, std::move(loader), generation);
+        m_starting = 0;
+        // may be done already (e.g. loader returned finished future), then it's cached already
+        if (!shared.isReady()) {
+            m_loading.insert(key, Loading{shared.m_state, generation});
+        }
+        return Lookup{std::nullopt, shared.m_state, std::nullopt};
+    }
+
+    /*
+     * drops cached value, in-flight load (if any) is left to its' waiters, but isn't cached
+     */
+    void remove(const K &key)
+    {
+        m_values.remove(key);
+        m_loading.remove(key);
+    }
+
+    bool contains(const K &key) const
+    {
+        return m_values.contains(key);
+    }
+
+    qsizetype totalCost() const
+    {
+        return m_values.totalCost();
+    }
+
+private:
+    struct Entry
+    {
+        V value;
+        QDeadlineTimer expires;
+    };
+
+    struct Loading
+    {
+        std::shared_ptr<SharedState<V>> state;
+        quint64 generation = 0;
+    };
+
+    /*
+     * lives in load's frame, so aborted load drops its' in-flight entry
+     */
+    struct LoadGuard
+    {
+        ~LoadGuard()
+        {
+            if (!done) {
+#ifdef COSIGNAL_DEBUG
+                qDebug() << "dropping in-flight cache entry because its' load was aborted";
+#endif
+                cache->forget(key, generation);
+            }
+        }
+
+        AsyncCache *cache;
+        const K &key;
+        quint64 generation;
+        bool done = false;
+    };
+
+    template<typename Loader>
+    static Async<V> load(QObject &, AsyncCache *cache, K key, Loader loader, quint64 generation)
+    {
+        LoadGuard guard{cache, key, generation};
+        V value = co_await loader(key);
+        guard.done = true;
+        cache->store(key, value, generation);
+        co_return value;
+    }
+
+    void store(const K &key, const V &value, quint64 generation)
+    {
+        // removed (or replaced) while loading
+        auto loading = m_loading.find(key);
+        if (loading != m_loading.end()) {
+            if (loading->generation != generation) {
+                return;
+            }
+            m_loading.erase(loading);
+        } else if (generation != m_starting) {
+            // only a load finishing right inside of `get()` isn't registered yet
+            return;
+        }
+
+        const QDeadlineTimer expires = m_ttl.count() > 0 ? QDeadlineTimer(m_ttl) : QDeadlineTimer(QDeadlineTimer::Forever);
+        m_values.insert(key, new Entry{value, expires}, m_cost ? m_cost(value) : 1);
+    }
+
+    void forget(const K &key, quint64 generation)
+    {
+        auto loading = m_loading.find(key);
+        if (loading != m_loading.end() && loading->generation == generation) {
+            m_loading.erase(loading);
+        }
+    }
+
+    QObject *const m_owner;
+    const std::chrono::milliseconds m_ttl;
+    const Cost m_cost;
+
+    QCache<K, Entry> m_values;
+    QHash<K, Loading> m_loading;
+    quint64 m_generation = 0;
+    // load being started by `get()` right now
+    quint64 m_starting = 0;
+};
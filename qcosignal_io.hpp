@@ -0,0 +1,1910 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QIODevice>
+#include <QFile>
+#include <QHash>
+#include <QProcess>
+#include <QSocketNotifier>
+#include <QtConcurrent>
+
+/*
+ * io_uring is used for file I/O when it's available (and not disabled with `-DCOSIGNAL_IO_URING=0`),
+ * raw syscalls are enough for that, so there is no dependency on liburing
+ */
+#ifndef COSIGNAL_IO_URING
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define COSIGNAL_IO_URING 1
+#else
+#define COSIGNAL_IO_URING 0
+#endif
+#endif
+
+#if COSIGNAL_IO_URING
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+// older headers
+#ifndef IORING_SQ_CQ_OVERFLOW
+#define IORING_SQ_CQ_OVERFLOW (1U << 1)
+#endif
+#endif
+
+#include "qcosignal.hpp"
+
+/*
+ * I/O extensions for coroutines from `qcosignal.hpp`
+ *
+ * kept in separate header, so core stays small and doesn't drag in stuff
+ * nobody asked for
+ */
+
+// =============================================================================
+
+/*
+ * pool of raw memory blocks for reads
+ *
+ * default (per-thread) pool hands out power-of-two sized blocks and recycles them
+ * on release, so steady-state reading doesn't touch the allocator at all
+ *
+ * fixed pool slices preallocated region into equal numbered blocks and never
+ * allocates — that's what io_uring registered buffers are made of
+ */
+class BufferPool
+{
+public:
+    struct Block
+    {
+        char *data = nullptr;
+        qsizetype capacity = 0;
+        // pool to return block to, `nullptr` — default pool of releasing thread
+        BufferPool *pool = nullptr;
+        // index inside fixed pool
+        int index = -1;
+    };
+
+    static BufferPool &local()
+    {
+        thread_local BufferPool pool;
+        return pool;
+    }
+
+    BufferPool() = default;
+
+    BufferPool(char *region, qsizetype blockSize, int count)
+        : m_fixedBlockSize(blockSize)
+    {
+        m_free.reserve(count);
+        for (int i = count; i-- > 0;) {
+            m_free.push_back({ region + i * blockSize, blockSize, this, i });
+        }
+    }
+
+    BufferPool(const BufferPool &) = delete;
+    BufferPool &operator=(const BufferPool &) = delete;
+
+    ~BufferPool()
+    {
+        if (m_fixedBlockSize) {
+            return;
+        }
+
+        for (Block &block : m_free) {
+            delete[] block.data;
+        }
+    }
+
+    /*
+     * fixed pool returns empty block if `size` doesn't fit or all blocks are in use
+     */
+    Block acquire(qsizetype size)
+    {
+        if (m_fixedBlockSize) {
+            if (size > m_fixedBlockSize || m_free.empty()) {
+                return {};
+            }
+
+            Block block = m_free.back();
+            m_free.pop_back();
+            return block;
+        }
+
+        // too big to be pooled anyway, so no point in rounding up
+        if (size > MaxPooledSize) {
+            return { new char[size], size };
+        }
+
+        qsizetype capacity = MinBlockSize;
+        while (capacity < size) {
+            capacity <<= 1;
+        }
+
+        for (size_t i = m_free.size(); i-- > 0;) {
+            if (m_free[i].capacity == capacity) {
+                Block block = m_free[i];
+                m_free[i] = m_free.back();
+                m_free.pop_back();
+                return block;
+            }
+        }
+
+        return { new char[capacity], capacity };
+    }
+
+    void release(Block block)
+    {
+        if (m_fixedBlockSize) {
+            m_free.push_back(block);
+            return;
+        }
+
+        if (m_free.size() >= MaxFreeBlocks || block.capacity > MaxPooledSize) {
+            delete[] block.data;
+            return;
+        }
+        m_free.push_back(block);
+    }
+
+    size_t freeBlocks() const
+    {
+        return m_free.size();
+    }
+
+private:
+    static constexpr qsizetype MinBlockSize = 4096;
+    static constexpr qsizetype MaxPooledSize = 4 * 1024 * 1024;
+    static constexpr size_t MaxFreeBlocks = 64;
+
+    qsizetype m_fixedBlockSize = 0;
+    std::vector<Block> m_free;
+};
+
+/*
+ * move-only owner of pooled block with some bytes in it
+ *
+ * data is accessed through views, copy into QByteArray only when you really want it
+ * block goes back into its' fixed pool, or into default pool of the thread destroying the buffer
+ */
+class PooledBuffer
+{
+public:
+    PooledBuffer() = default;
+
+    explicit PooledBuffer(qsizetype capacity)
+        : m_block(BufferPool::local().acquire(capacity))
+    {}
+
+    explicit PooledBuffer(BufferPool::Block block)
+        : m_block(block)
+    {}
+
+    PooledBuffer(PooledBuffer &&other) noexcept
+        : m_block(std::exchange(other.m_block, {}))
+        , m_size(std::exchange(other.m_size, 0))
+    {}
+
+    PooledBuffer &operator=(PooledBuffer &&other) noexcept
+    {
+        if (this != &other) {
+            reset();
+            m_block = std::exchange(other.m_block, {});
+            m_size = std::exchange(other.m_size, 0);
+        }
+        return *this;
+    }
+
+    PooledBuffer(const PooledBuffer &) = delete;
+    PooledBuffer &operator=(const PooledBuffer &) = delete;
+
+    ~PooledBuffer()
+    {
+        reset();
+    }
+
+    char *data() { return m_block.data; }
+    const char *data() const { return m_block.data; }
+    qsizetype size() const { return m_size; }
+    qsizetype capacity() const { return m_block.capacity; }
+    bool isEmpty() const { return m_size == 0; }
+
+    void setSize(qsizetype size)
+    {
+        Q_ASSERT(size >= 0 && size <= m_block.capacity);
+        m_size = size;
+    }
+
+    QByteArrayView view() const { return QByteArrayView(m_block.data, m_size); }
+    operator QByteArrayView() const { return view(); }
+
+    // the only place where bytes are copied
+    QByteArray toByteArray() const { return QByteArray(m_block.data, m_size); }
+
+    void reset()
+    {
+        if (m_block.data) {
+            (m_block.pool ? *m_block.pool : BufferPool::local()).release(m_block);
+        }
+        m_block = {};
+        m_size = 0;
+    }
+
+private:
+    BufferPool::Block m_block;
+    qsizetype m_size = 0;
+};
+
+// =============================================================================
+
+/*
+ * common part of QIODevice awaiters
+ *
+ * unlike plain `CoSignal(device, &QIODevice::readyRead)` condition is checked
+ * before suspending and on every notification, so there are no lost wakeups —
+ * data arrived before `co_await` is seen by `await_ready()`
+ *
+ * coroutine is resumed early (with partial result) when device is closed
+ * or its' read channel is finished, and aborted when device is destroyed
+ */
+template<typename Derived>
+struct IODeviceAwaiter
+{
+    explicit IODeviceAwaiter(QIODevice *device)
+        : m_device(device)
+    {}
+
+    ~IODeviceAwaiter()
+    {
+        disconnect();
+    }
+
+    bool await_ready()
+    {
+        return !m_device || !m_device->isOpen() || derived().ready();
+    }
+
+    void await_suspend(std::coroutine_handle<> untypedHandle)
+    {
+        /*
+         * also assuming `this` is `co_await`-ed by CoroutineController<X>
+         */
+        m_handle = reinterpret_cast<Handle&>(untypedHandle);
+        QObject *owner = m_handle.promise().m_object;
+
+        m_destroyedConnection = QObject::connect(
+            m_device,
+            &QObject::destroyed,
+            owner,
+            [this] {
+#ifdef COSIGNAL_DEBUG
+                qDebug() << "aborting coroutine awaiting on device because it was destroyed";
+#endif
+                this->m_device = nullptr;
+                this->m_handle.promise().abort(AbortReason::SenderDestroyed);
+            }
+        );
+
+        m_connection = QObject::connect(
+            m_device,
+            Derived::Notification,
+            owner,
+            [this] {
+                if (derived().ready()) {
+                    this->wake();
+                }
+            }
+        );
+
+        m_closedConnection = QObject::connect(m_device, &QIODevice::aboutToClose, owner, [this] { this->wake(); });
+        if constexpr (Derived::Reading) {
+            m_finishedConnection = QObject::connect(
+                m_device,
+                &QIODevice::readChannelFinished,
+                owner,
+                [this] { this->wake(); }
+            );
+        }
+    }
+
+protected:
+    Derived &derived() { return static_cast<Derived&>(*this); }
+
+    void disconnect()
+    {
+        QObject::disconnect(m_connection);
+        QObject::disconnect(m_closedConnection);
+        QObject::disconnect(m_finishedConnection);
+        QObject::disconnect(m_destroyedConnection);
+    }
+
+    void wake()
+    {
+        disconnect();
+        m_handle.resume();
+    }
+
+    /*
+     * reads up to `size` bytes (but no more than available) into pooled buffer
+     */
+    PooledBuffer readAvailable(qint64 size)
+    {
+        if (!m_device) {
+            return {};
+        }
+
+        size = qMin(size, m_device->bytesAvailable());
+        if (size <= 0) {
+            return {};
+        }
+
+        PooledBuffer buffer(size);
+        qint64 read = m_device->read(buffer.data(), size);
+        buffer.setSize(qMax<qint64>(read, 0));
+        return buffer;
+    }
+
+    QPointer<QIODevice> m_device;
+    Handle m_handle;
+
+    QMetaObject::Connection m_connection;
+    QMetaObject::Connection m_closedConnection;
+    QMetaObject::Connection m_finishedConnection;
+    QMetaObject::Connection m_destroyedConnection;
+};
+
+/*
+ * `co_await readExactly(device, n)` — resumes when `n` bytes are available
+ * result is shorter than `n` only if device was closed
+ */
+struct ReadExactlyAwaiter : IODeviceAwaiter<ReadExactlyAwaiter>
+{
+    static constexpr bool Reading = true;
+    static constexpr auto Notification = &QIODevice::readyRead;
+
+    ReadExactlyAwaiter(QIODevice *device, qint64 size)
+        : IODeviceAwaiter(device)
+        , m_size(size)
+    {}
+
+    bool ready() const
+    {
+        return m_device->bytesAvailable() >= m_size;
+    }
+
+    PooledBuffer await_resume()
+    {
+        return readAvailable(m_size);
+    }
+
+private:
+    qint64 m_size;
+};
+
+/*
+ * `co_await readSome(device, maxSize)` — resumes when at least one byte is available
+ * empty result means device was closed
+ */
+struct ReadSomeAwaiter : IODeviceAwaiter<ReadSomeAwaiter>
+{
+    static constexpr bool Reading = true;
+    static constexpr auto Notification = &QIODevice::readyRead;
+
+    ReadSomeAwaiter(QIODevice *device, qint64 maxSize)
+        : IODeviceAwaiter(device)
+        , m_maxSize(maxSize)
+    {}
+
+    bool ready() const
+    {
+        return m_device->bytesAvailable() > 0;
+    }
+
+    PooledBuffer await_resume()
+    {
+        return readAvailable(m_maxSize);
+    }
+
+private:
+    qint64 m_maxSize;
+};
+
+/*
+ * `co_await readLine(device)` — resumes when whole line (including '\n') is available
+ * or `maxSize` bytes were buffered without one (0 means no limit)
+ */
+struct ReadLineAwaiter : IODeviceAwaiter<ReadLineAwaiter>
+{
+    static constexpr bool Reading = true;
+    static constexpr auto Notification = &QIODevice::readyRead;
+
+    ReadLineAwaiter(QIODevice *device, qint64 maxSize)
+        : IODeviceAwaiter(device)
+        , m_maxSize(maxSize)
+    {}
+
+    bool ready() const
+    {
+        return m_device->canReadLine() || (m_maxSize > 0 && m_device->bytesAvailable() >= m_maxSize);
+    }
+
+    PooledBuffer await_resume()
+    {
+        if (!m_device) {
+            return {};
+        }
+
+        qint64 size = m_device->bytesAvailable();
+        if (m_maxSize > 0) {
+            size = qMin(size, m_maxSize);
+        }
+        if (size <= 0) {
+            return {};
+        }
+
+        // QIODevice::readLine() wants space for terminating '\0'
+        PooledBuffer buffer(size + 1);
+        qint64 read = m_device->readLine(buffer.data(), size + 1);
+        buffer.setSize(qMax<qint64>(read, 0));
+        return buffer;
+    }
+
+private:
+    qint64 m_maxSize;
+};
+
+/*
+ * `co_await writeAll(device, data)` — hands all of `data` to device right away,
+ * then resumes when no more than `highWatermark` bytes are left in device's
+ * write buffer, so fast producer can't bloat it indefinitely
+ *
+ * returns number of bytes accepted by device, -1 on error (or missing device)
+ *
+ * not named `write()`, so POSIX `::write()` isn't overloaded by it
+ */
+struct WriteAwaiter : IODeviceAwaiter<WriteAwaiter>
+{
+    static constexpr bool Reading = false;
+    static constexpr auto Notification = &QIODevice::bytesWritten;
+
+    WriteAwaiter(QIODevice *device, QByteArrayView data, qint64 highWatermark)
+        : IODeviceAwaiter(device)
+        , m_highWatermark(highWatermark)
+        , m_written(device ? device->write(data.data(), data.size()) : -1)
+    {}
+
+    bool ready() const
+    {
+        return m_written < 0 || m_device->bytesToWrite() <= m_highWatermark;
+    }
+
+    qint64 await_resume() const
+    {
+        return m_written;
+    }
+
+private:
+    qint64 m_highWatermark;
+    qint64 m_written;
+};
+
+inline ReadExactlyAwaiter readExactly(QIODevice *device, qint64 size)
+{
+    return ReadExactlyAwaiter(device, size);
+}
+
+inline ReadSomeAwaiter readSome(QIODevice *device, qint64 maxSize = 64 * 1024)
+{
+    return ReadSomeAwaiter(device, maxSize);
+}
+
+inline ReadLineAwaiter readLine(QIODevice *device, qint64 maxSize = 0)
+{
+    return ReadLineAwaiter(device, maxSize);
+}
+
+inline WriteAwaiter writeAll(QIODevice *device, QByteArrayView data, qint64 highWatermark = 1024 * 1024)
+{
+    return WriteAwaiter(device, data, highWatermark);
+}
+
+// =============================================================================
+
+/*
+ * deleter for owned QProcess
+ *
+ * ~QProcess() kills still running process and then blocks until it's reaped,
+ * here process is killed and left to delete itself when it's finished,
+ * so aborting coroutine never blocks the event loop
+ */
+struct ProcessKiller
+{
+    void operator()(QProcess *process) const
+    {
+        if (process->state() == QProcess::NotRunning) {
+            delete process;
+            return;
+        }
+
+        QObject::connect(process, &QProcess::finished, process, &QObject::deleteLater);
+        // still starting process may fail to start instead, `finished` isn't emitted then
+        QObject::connect(process, &QProcess::errorOccurred, process, [process] {
+            if (process->state() == QProcess::NotRunning) {
+                process->deleteLater();
+            }
+        });
+        process->kill();
+    }
+};
+
+using ProcessPointer = std::unique_ptr<QProcess, ProcessKiller>;
+
+struct ProcessResult
+{
+    // `false` if process failed to start, everything below is meaningless then
+    bool started = false;
+    int exitCode = -1;
+    QProcess::ExitStatus exitStatus = QProcess::CrashExit;
+    QByteArray standardOutput;
+    QByteArray standardError;
+};
+
+/*
+ * `co_await runProcess(program, arguments)` — starts process and resumes when it's finished
+ * (or failed to start), no threads are blocked in the meantime
+ *
+ * process is killed if awaiting coroutine is aborted
+ */
+struct RunProcessAwaiter
+{
+    RunProcessAwaiter(QString program, QStringList arguments, QByteArray input)
+        : m_program(std::move(program))
+        , m_arguments(std::move(arguments))
+        , m_input(std::move(input))
+    {}
+
+    RunProcessAwaiter(RunProcessAwaiter &&) = default;
+
+    ~RunProcessAwaiter()
+    {
+        QObject::disconnect(m_finishedConnection);
+        QObject::disconnect(m_errorConnection);
+    }
+
+    bool await_ready() const
+    {
+        return false;
+    }
+
+    bool await_suspend(std::coroutine_handle<> untypedHandle)
+    {
+        /*
+         * also assuming `this` is `co_await`-ed by CoroutineController<X>
+         */
+        m_handle = reinterpret_cast<Handle&>(untypedHandle);
+        QObject *owner = m_handle.promise().m_object;
+
+        m_process.reset(new QProcess);
+        m_process->start(m_program, m_arguments);
+
+        // program wasn't even found — nothing to wait for
+        if (m_process->state() == QProcess::NotRunning) {
+            return false;
+        }
+
+        if (!m_input.isEmpty()) {
+            m_process->write(m_input);
+        }
+        m_process->closeWriteChannel();
+
+        m_finishedConnection = QObject::connect(
+            m_process.get(),
+            &QProcess::finished,
+            owner,
+            [this] { this->wake(); }
+        );
+        m_errorConnection = QObject::connect(
+            m_process.get(),
+            &QProcess::errorOccurred,
+            owner,
+            [this](QProcess::ProcessError error) {
+                if (error == QProcess::FailedToStart) {
+                    this->wake();
+                }
+            }
+        );
+
+        return true;
+    }
+
+    ProcessResult await_resume()
+    {
+        ProcessResult result;
+        result.started = m_process->error() != QProcess::FailedToStart;
+        if (result.started) {
+            result.exitCode = m_process->exitCode();
+            result.exitStatus = m_process->exitStatus();
+            result.standardOutput = m_process->readAllStandardOutput();
+            result.standardError = m_process->readAllStandardError();
+        }
+        return result;
+    }
+
+private:
+    void wake()
+    {
+        QObject::disconnect(m_finishedConnection);
+        QObject::disconnect(m_errorConnection);
+        m_handle.resume();
+    }
+
+    QString m_program;
+    QStringList m_arguments;
+    QByteArray m_input;
+
+    ProcessPointer m_process;
+    Handle m_handle;
+
+    QMetaObject::Connection m_finishedConnection;
+    QMetaObject::Connection m_errorConnection;
+};
+
+inline RunProcessAwaiter runProcess(QString program, QStringList arguments = {}, QByteArray input = {})
+{
+    return RunProcessAwaiter(std::move(program), std::move(arguments), std::move(input));
+}
+
+struct ProcessChunk
+{
+    QProcess::ProcessChannel channel;
+    PooledBuffer data;
+};
+
+/*
+ * streaming counterpart of `runProcess()`
+ *
+ *   ProcessStream process("find", {"/"});
+ *   while (std::optional<ProcessChunk> chunk = co_await process.next()) {
+ *       ...
+ *   }
+ *   qDebug() << process.exitCode();
+ *
+ * output isn't queued on our side — it stays in QProcess' own buffers until
+ * consumer asks for the next chunk, and every chunk is at most `maxChunkSize` bytes
+ * (QProcess itself has no way to stop reading from the pipe, so that's the best bound we can get)
+ *
+ * process is killed when stream is destroyed, which is also the case when
+ * coroutine holding it is aborted
+ */
+class ProcessStream
+{
+public:
+    struct NextAwaiter
+    {
+        ProcessStream *stream;
+
+        ~NextAwaiter()
+        {
+            stream->disconnect();
+        }
+
+        bool await_ready() const
+        {
+            return stream->hasChunk();
+        }
+
+        void await_suspend(std::coroutine_handle<> untypedHandle)
+        {
+            stream->suspend(reinterpret_cast<Handle&>(untypedHandle));
+        }
+
+        std::optional<ProcessChunk> await_resume()
+        {
+            return stream->takeChunk();
+        }
+    };
+
+    ProcessStream(QString program, QStringList arguments = {}, qint64 maxChunkSize = 64 * 1024)
+        : m_process(new QProcess)
+        , m_maxChunkSize(maxChunkSize)
+    {
+        m_process->start(program, arguments);
+        m_process->closeWriteChannel();
+    }
+
+    ProcessStream(const ProcessStream &) = delete;
+    ProcessStream &operator=(const ProcessStream &) = delete;
+
+    ~ProcessStream()
+    {
+        disconnect();
+    }
+
+    /*
+     * awaitable for the next chunk of output, empty optional — process has finished
+     * and everything was read
+     */
+    NextAwaiter next()
+    {
+        return { this };
+    }
+
+    QProcess *process() const { return m_process.get(); }
+    int exitCode() const { return m_process->exitCode(); }
+    QProcess::ExitStatus exitStatus() const { return m_process->exitStatus(); }
+
+private:
+    bool available(QProcess::ProcessChannel channel) const
+    {
+        m_process->setReadChannel(channel);
+        return m_process->bytesAvailable() > 0;
+    }
+
+    bool hasChunk() const
+    {
+        return m_process->state() == QProcess::NotRunning
+            || available(QProcess::StandardOutput)
+            || available(QProcess::StandardError);
+    }
+
+    std::optional<ProcessChunk> takeChunk()
+    {
+        for (QProcess::ProcessChannel channel : { QProcess::StandardOutput, QProcess::StandardError }) {
+            if (!available(channel)) {
+                continue;
+            }
+
+            qint64 size = qMin(m_process->bytesAvailable(), m_maxChunkSize);
+            PooledBuffer buffer(size);
+            buffer.setSize(qMax<qint64>(m_process->read(buffer.data(), size), 0));
+            return ProcessChunk{ channel, std::move(buffer) };
+        }
+
+        return std::nullopt;
+    }
+
+    void suspend(Handle handle)
+    {
+        m_handle = handle;
+        QObject *owner = handle.promise().m_object;
+        auto wake = [this] {
+            if (this->hasChunk()) {
+                this->disconnect();
+                this->m_handle.resume();
+            }
+        };
+
+        m_connections[0] = QObject::connect(m_process.get(), &QProcess::readyReadStandardOutput, owner, wake);
+        m_connections[1] = QObject::connect(m_process.get(), &QProcess::readyReadStandardError, owner, wake);
+        m_connections[2] = QObject::connect(m_process.get(), &QProcess::finished, owner, wake);
+        m_connections[3] = QObject::connect(m_process.get(), &QProcess::errorOccurred, owner, wake);
+    }
+
+    void disconnect()
+    {
+        for (QMetaObject::Connection &connection : m_connections) {
+            QObject::disconnect(connection);
+        }
+    }
+
+    ProcessPointer m_process;
+    qint64 m_maxChunkSize;
+    Handle m_handle;
+    QMetaObject::Connection m_connections[4];
+};
+
+// =============================================================================
+
+/*
+ * single outstanding file operation
+ *
+ * lives on the heap, because kernel (or pool thread) may still be using it
+ * after awaiting coroutine was aborted — then it's orphaned and deleted on completion
+ *
+ * `handle` is awaiting coroutine, empty when it was aborted, and node itself is linked
+ * into the queue's list of operations in flight
+ */
+struct FileOperation : WaiterNode
+{
+    ~FileOperation()
+    {
+        if (ownedFd >= 0) {
+            ::close(ownedFd);
+        }
+    }
+
+    CoroutineControllerBase<> &promise() const
+    {
+        return std::coroutine_handle<CoroutineControllerBase<>>::from_address(handle.address()).promise();
+    }
+
+    // transferred bytes or -errno
+    qint64 result = 0;
+    // resume of the coroutine was posted to its' owner's new thread
+    bool completed = false;
+    // read destination
+    PooledBuffer buffer;
+    // write source, kept alive while somebody may read it
+    QByteArray data;
+    // closed together with operation (see `readFile()`)
+    int ownedFd = -1;
+    // index of registered buffer, when reading into one
+    int fixedIndex = -1;
+    // whole file is read chunk after chunk into `buffer` (see `readFile()`)
+    bool whole = false;
+    int fd = -1;
+    qint64 offset = 0;
+    // size of the last read chunk, anything less means end of file
+    qint64 requested = 0;
+    // pool thread doing the work without io_uring
+    std::optional<QFuture<qint64>> running;
+};
+
+/*
+ * per-thread queue of file operations
+ *
+ * with io_uring submissions made during one event loop iteration are batched
+ * into single `io_uring_enter()`, and completions are harvested on the same thread
+ * via eventfd + QSocketNotifier, so no threads are blocked at all
+ *
+ * small reads go into registered (fixed) buffers when there are free ones
+ *
+ * without io_uring every operation is a blocking `pread()`/`pwrite()` in QtConcurrent pool
+ */
+class FileIOQueue
+{
+public:
+    static FileIOQueue &local()
+    {
+        thread_local FileIOQueue queue;
+        return queue;
+    }
+
+    FileIOQueue(const FileIOQueue &) = delete;
+    FileIOQueue &operator=(const FileIOQueue &) = delete;
+
+    bool usesUring() const
+    {
+#if COSIGNAL_IO_URING
+        return m_ringFd >= 0;
+#else
+        return false;
+#endif
+    }
+
+    const std::shared_ptr<RegistryLock> &lock() const
+    {
+        return m_lock;
+    }
+
+    /*
+     * `false` if operation can't be started right now (submission ring is full),
+     * then it's completed with `-EBUSY` right away
+     */
+    bool read(FileOperation *op, int fd, qint64 offset, qint64 size)
+    {
+        size = qMin(size, MaxChunk);
+        op->fd = fd;
+        op->offset = offset;
+
+#if COSIGNAL_IO_URING
+        BufferPool::Block fixed = m_fixedPool ? m_fixedPool->acquire(size) : BufferPool::Block{};
+        if (fixed.data) {
+            op->buffer = PooledBuffer(fixed);
+            op->fixedIndex = fixed.index;
+        } else
+#endif
+        {
+            op->buffer = PooledBuffer(size);
+        }
+
+        return readChunk(op, size);
+    }
+
+    /*
+     * whole file, `sizeHint` is its' size according to `fstat()` (zero for procfs, sysfs and such)
+     */
+    bool readWhole(FileOperation *op, int fd, qint64 sizeHint)
+    {
+        op->whole = true;
+        // one byte more, so end of regular file is seen right away as a short read
+        return read(op, fd, 0, sizeHint > 0 ? sizeHint + 1 : MinWholeChunk);
+    }
+
+    bool write(FileOperation *op, int fd, qint64 offset)
+    {
+#if COSIGNAL_IO_URING
+        if (usesUring()) {
+            io_uring_sqe *sqe = nextSqe();
+            if (!sqe) {
+                op->result = -EBUSY;
+                return false;
+            }
+            sqe->opcode = IORING_OP_WRITE;
+            sqe->fd = fd;
+            sqe->off = offset;
+            sqe->addr = reinterpret_cast<quintptr>(op->data.constData());
+            sqe->len = op->data.size();
+            sqe->user_data = reinterpret_cast<quintptr>(op);
+            m_inFlight.push_back(op);
+            return true;
+        }
+#endif
+
+        QByteArray data = op->data;
+        op->running = QtConcurrent::run([fd, offset, data] {
+            qint64 result = ::pwrite(fd, data.constData(), data.size(), offset);
+            return result < 0 ? qint64(-errno) : result;
+        });
+        op->running->then(&m_context, [this, op](qint64 result) {
+            complete(op, result);
+        });
+        m_inFlight.push_back(op);
+        return true;
+    }
+
+    /*
+     * awaiting coroutine is gone, operation will be deleted as soon as it's completed
+     *
+     * from any thread — coroutine may be aborted in the thread its' owner was moved to,
+     * ring belongs to the queue's thread though, so operation is canceled only from there
+     */
+    static void orphan(const std::shared_ptr<RegistryLock> &lock, FileIOQueue *queue, FileOperation *op)
+    {
+        std::unique_lock guard(lock->mutex);
+        if (op->completed) {
+            // aborted before posted resume was delivered
+            guard.unlock();
+            delete op;
+            return;
+        }
+
+        op->handle = {};
+        if (!lock->inRegistryThread()) {
+            // left to complete on its' own (queue exiting along with its' thread completes it too)
+            return;
+        }
+        guard.unlock();
+
+#if COSIGNAL_IO_URING
+        // no room for cancellation — operation just completes on its' own
+        io_uring_sqe *sqe = queue->usesUring() ? queue->nextSqe() : nullptr;
+        if (sqe) {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = reinterpret_cast<quintptr>(op);
+            sqe->user_data = 0;
+        }
+#else
+        Q_UNUSED(queue);
+#endif
+    }
+
+private:
+    // that's the most single read(2) will do anyway
+    static constexpr qint64 MaxChunk = 0x7ffff000;
+    // first chunk of whole file of unknown size
+    static constexpr qint64 MinWholeChunk = 64 * 1024;
+
+    /*
+     * next `size` bytes of `op->offset` into free space of `op->buffer`
+     */
+    bool readChunk(FileOperation *op, qint64 size)
+    {
+        op->requested = size;
+        char *destination = op->buffer.data() + op->buffer.size();
+        qint64 offset = op->offset + op->buffer.size();
+
+#if COSIGNAL_IO_URING
+        if (usesUring()) {
+            io_uring_sqe *sqe = nextSqe();
+            if (!sqe) {
+                op->result = -EBUSY;
+                return false;
+            }
+            sqe->opcode = op->fixedIndex >= 0 ? IORING_OP_READ_FIXED : IORING_OP_READ;
+            sqe->fd = op->fd;
+            sqe->off = offset;
+            sqe->addr = reinterpret_cast<quintptr>(destination);
+            sqe->len = size;
+            sqe->buf_index = op->fixedIndex >= 0 ? op->fixedIndex : 0;
+            sqe->user_data = reinterpret_cast<quintptr>(op);
+            m_inFlight.push_back(op);
+            return true;
+        }
+#endif
+
+        int fd = op->fd;
+        op->running = QtConcurrent::run([fd, offset, size, destination] {
+            qint64 result = ::pread(fd, destination, size, offset);
+            return result < 0 ? qint64(-errno) : result;
+        });
+        op->running->then(&m_context, [this, op](qint64 result) {
+            complete(op, result);
+        });
+        m_inFlight.push_back(op);
+        return true;
+    }
+
+    /*
+     * chunk of whole file read, `true` if the next one is on its' way
+     */
+    bool continueWhole(FileOperation *op, qint64 result)
+    {
+        op->buffer.setSize(op->buffer.size() + result);
+        if (result < op->requested) {
+            return false;
+        }
+
+        if (op->buffer.size() == op->buffer.capacity()) {
+            // file is bigger than it said (or has no size at all)
+            PooledBuffer bigger(op->buffer.capacity() * 2);
+            std::memcpy(bigger.data(), op->buffer.data(), op->buffer.size());
+            bigger.setSize(op->buffer.size());
+            op->buffer = std::move(bigger);
+            op->fixedIndex = -1;
+        }
+        return readChunk(op, qMin(op->buffer.capacity() - op->buffer.size(), MaxChunk));
+    }
+
+    FileIOQueue()
+        : m_lock(std::make_shared<RegistryLock>())
+    {
+        m_lock->context = &m_context;
+#if COSIGNAL_IO_URING
+        if (!setupUring()) {
+            teardownUring();
+        }
+#endif
+    }
+
+    /*
+     * thread is exiting — everything still in flight is finished right here: once kernel (or pool thread)
+     * is done with it, coroutines of owners moved to other threads are resumed there,
+     * and operations of aborted ones are deleted
+     */
+    ~FileIOQueue()
+    {
+        std::lock_guard guard(m_lock->mutex);
+        m_lock->context = nullptr;
+
+#if COSIGNAL_IO_URING
+        if (usesUring()) {
+            drainUring();
+        }
+#endif
+        while (WaiterNode *node = m_inFlight.pop_front()) {
+            FileOperation *op = static_cast<FileOperation*>(node);
+            if (op->running) {
+                op->running->waitForFinished();
+                abandon(op, op->running->result());
+            } else {
+                // ring is broken, there is nothing to wait for
+                abandon(op, -ECANCELED);
+            }
+        }
+
+#if COSIGNAL_IO_URING
+        teardownUring();
+#endif
+    }
+
+    /*
+     * operation won't be completed by the queue anymore, called under the lock
+     */
+    static void abandon(FileOperation *op, qint64 result)
+    {
+        if (!op->handle) {
+            delete op;
+            return;
+        }
+
+        // part of the file is of no use
+        op->result = op->whole && result >= 0 ? -ECANCELED : result;
+        // taken back by the awaiter, either when resumed in owner's new thread or when destroyed
+        op->completed = true;
+        op->promise().post_resume_if_moved();
+    }
+
+    void complete(FileOperation *op, qint64 result)
+    {
+        std::unique_lock guard(m_lock->mutex);
+        m_inFlight.remove(op);
+        if (!op->handle) {
+            guard.unlock();
+            delete op;
+            return;
+        }
+
+        if (op->whole && result >= 0) {
+            if (result > 0 && continueWhole(op, result)) {
+                return;
+            }
+            // either whole file or `-EBUSY` from the next chunk
+            result = op->result < 0 ? op->result : op->buffer.size();
+        }
+
+        op->result = result;
+        if (op->promise().post_resume_if_moved()) {
+            // taken back by the awaiter, either when resumed or when destroyed
+            op->completed = true;
+            return;
+        }
+
+        // owner is in this thread, so nobody else can abort the coroutine now
+        guard.unlock();
+        op->handle.resume();
+    }
+
+#if COSIGNAL_IO_URING
+    static constexpr unsigned RingEntries = 256;
+    static constexpr qsizetype FixedBlockSize = 64 * 1024;
+    static constexpr int FixedBlockCount = 32;
+
+    bool setupUring()
+    {
+        io_uring_params params = {};
+        m_ringFd = ::syscall(__NR_io_uring_setup, RingEntries, &params);
+        if (m_ringFd < 0 || !(params.features & IORING_FEAT_SINGLE_MMAP)) {
+            return false;
+        }
+
+        m_ringSize = qMax(
+            params.sq_off.array + params.sq_entries * sizeof(unsigned),
+            params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe)
+        );
+        m_ring = ::mmap(nullptr, m_ringSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQ_RING);
+        if (m_ring == MAP_FAILED) {
+            return false;
+        }
+
+        m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        void *sqes = ::mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ringFd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            return false;
+        }
+        m_sqes = static_cast<io_uring_sqe*>(sqes);
+
+        char *ring = static_cast<char*>(m_ring);
+        m_sqHead = reinterpret_cast<unsigned*>(ring + params.sq_off.head);
+        m_sqTail = reinterpret_cast<unsigned*>(ring + params.sq_off.tail);
+        m_sqFlags = reinterpret_cast<unsigned*>(ring + params.sq_off.flags);
+        m_sqMask = *reinterpret_cast<unsigned*>(ring + params.sq_off.ring_mask);
+        m_sqArray = reinterpret_cast<unsigned*>(ring + params.sq_off.array);
+        m_sqEntries = params.sq_entries;
+        m_cqHead = reinterpret_cast<unsigned*>(ring + params.cq_off.head);
+        m_cqTail = reinterpret_cast<unsigned*>(ring + params.cq_off.tail);
+        m_cqMask = *reinterpret_cast<unsigned*>(ring + params.cq_off.ring_mask);
+        m_cqes = reinterpret_cast<io_uring_cqe*>(ring + params.cq_off.cqes);
+
+        m_eventFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (m_eventFd < 0 || ::syscall(__NR_io_uring_register, m_ringFd, IORING_REGISTER_EVENTFD, &m_eventFd, 1) < 0) {
+            return false;
+        }
+
+        // registering buffers may fail because of RLIMIT_MEMLOCK — then just go without them
+        m_fixedRegion = new char[FixedBlockSize * FixedBlockCount];
+        iovec vectors[FixedBlockCount];
+        for (int i = 0; i < FixedBlockCount; ++i) {
+            vectors[i] = { m_fixedRegion + i * FixedBlockSize, size_t(FixedBlockSize) };
+        }
+        if (::syscall(__NR_io_uring_register, m_ringFd, IORING_REGISTER_BUFFERS, vectors, FixedBlockCount) == 0) {
+            m_fixedPool = new BufferPool(m_fixedRegion, FixedBlockSize, FixedBlockCount);
+        } else {
+            delete[] m_fixedRegion;
+            m_fixedRegion = nullptr;
+        }
+
+        m_notifier.reset(new QSocketNotifier(m_eventFd, QSocketNotifier::Read));
+        QObject::connect(m_notifier.get(), &QSocketNotifier::activated, &m_context, [this] { harvest(); });
+
+        return true;
+    }
+
+    /*
+     * cancels everything in flight (what's already being read or written just completes)
+     * and waits for kernel to be done with it
+     */
+    void drainUring()
+    {
+        for (WaiterNode *node = m_inFlight.first; node; node = node->next) {
+            // no room for cancellation — operation just completes on its' own
+            if (io_uring_sqe *sqe = nextSqe()) {
+                sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                sqe->addr = reinterpret_cast<quintptr>(static_cast<FileOperation*>(node));
+                sqe->user_data = 0;
+            }
+        }
+
+        while (!m_inFlight.empty()) {
+            submit();
+            if (::syscall(__NR_io_uring_enter, m_ringFd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR) {
+                return;
+            }
+
+            unsigned head = std::atomic_ref<unsigned>(*m_cqHead).load(std::memory_order_relaxed);
+            unsigned tail = std::atomic_ref<unsigned>(*m_cqTail).load(std::memory_order_acquire);
+            for (; head != tail; ++head) {
+                io_uring_cqe cqe = m_cqes[head & m_cqMask];
+                if (cqe.user_data) {
+                    FileOperation *op = reinterpret_cast<FileOperation*>(cqe.user_data);
+                    m_inFlight.remove(op);
+                    abandon(op, cqe.res);
+                }
+            }
+            std::atomic_ref<unsigned>(*m_cqHead).store(head, std::memory_order_release);
+        }
+    }
+
+    void teardownUring()
+    {
+        m_notifier.reset();
+
+        if (m_ringFd >= 0) {
+            // kernel is done with everything only after ring is closed
+            ::close(m_ringFd);
+            m_ringFd = -1;
+        }
+        if (m_eventFd >= 0) {
+            ::close(m_eventFd);
+            m_eventFd = -1;
+        }
+        if (m_sqes) {
+            ::munmap(m_sqes, m_sqesSize);
+            m_sqes = nullptr;
+        }
+        if (m_ring != MAP_FAILED) {
+            ::munmap(m_ring, m_ringSize);
+            m_ring = MAP_FAILED;
+        }
+
+        // buffers still held by somebody will return into pool later, so leaking it in that case
+        if (m_fixedPool && m_fixedPool->freeBlocks() == size_t(FixedBlockCount)) {
+            delete m_fixedPool;
+            delete[] m_fixedRegion;
+        }
+        m_fixedPool = nullptr;
+        m_fixedRegion = nullptr;
+    }
+
+    /*
+     * next free submission entry, it will be submitted with the whole batch
+     * when control returns to the event loop
+     *
+     * `nullptr` if ring is full and kernel can't take anything from it right now
+     */
+    io_uring_sqe *nextSqe()
+    {
+        if (sqFull()) {
+            submit();
+            if (sqFull()) {
+                return nullptr;
+            }
+        }
+
+        unsigned index = m_sqLocalTail & m_sqMask;
+        io_uring_sqe *sqe = &m_sqes[index];
+        *sqe = {};
+        m_sqArray[index] = index;
+        ++m_sqLocalTail;
+
+        scheduleSubmit();
+        return sqe;
+    }
+
+    bool sqFull() const
+    {
+        return m_sqLocalTail - std::atomic_ref<unsigned>(*m_sqHead).load(std::memory_order_acquire) >= m_sqEntries;
+    }
+
+    void scheduleSubmit()
+    {
+        if (!m_submitScheduled) {
+            m_submitScheduled = true;
+            QMetaObject::invokeMethod(&m_context, [this] { submitScheduled(); }, Qt::QueuedConnection);
+        }
+    }
+
+    /*
+     * hands everything queued so far to the kernel, or as much as it takes
+     *
+     * never completes anything by itself — it's called from inside of `co_await`-s too,
+     * returns errno if ring is broken
+     */
+    int submit()
+    {
+        std::atomic_ref<unsigned>(*m_sqTail).store(m_sqLocalTail, std::memory_order_release);
+
+        // kernel may consume only part of the batch, the rest stays in the ring for the next call
+        while (unsigned count = m_sqLocalTail - std::atomic_ref<unsigned>(*m_sqHead).load(std::memory_order_acquire)) {
+            long submitted = ::syscall(__NR_io_uring_enter, m_ringFd, count, 0, 0, nullptr, 0);
+            if (submitted > 0 || (submitted < 0 && errno == EINTR)) {
+                continue;
+            }
+            if (submitted == 0 || errno == EBUSY || errno == EAGAIN) {
+                // completion queue is full (or kernel is short on memory) — the rest goes
+                // on the next pass, after completions are harvested
+                scheduleSubmit();
+                return 0;
+            }
+            return errno;
+        }
+        return 0;
+    }
+
+    void submitScheduled()
+    {
+        m_submitScheduled = false;
+        if (int error = submit()) {
+            qWarning() << "io_uring_enter() failed:" << error;
+            failUnsubmitted(error);
+        }
+    }
+
+    /*
+     * takes back whatever kernel didn't consume and completes it with `-error`
+     */
+    void failUnsubmitted(int error)
+    {
+        unsigned head = std::atomic_ref<unsigned>(*m_sqHead).load(std::memory_order_acquire);
+        std::vector<FileOperation*> failed;
+        for (unsigned i = head; i != m_sqLocalTail; ++i) {
+            // user_data == 0 — cancellation request
+            if (quint64 userData = m_sqes[i & m_sqMask].user_data) {
+                failed.push_back(reinterpret_cast<FileOperation*>(userData));
+            }
+        }
+        // kernel reads tail only inside of `io_uring_enter()`, so it's safe to take entries back
+        m_sqLocalTail = head;
+        std::atomic_ref<unsigned>(*m_sqTail).store(head, std::memory_order_release);
+
+        for (FileOperation *op : failed) {
+            complete(op, -error);
+        }
+    }
+
+    void harvest()
+    {
+        quint64 counter;
+        while (::read(m_eventFd, &counter, sizeof(counter)) > 0) {}
+
+        /*
+         * head is reread from the ring every time — resumed coroutine may spin nested event loop,
+         * which harvests (and moves head) too
+         */
+        while (true) {
+            unsigned head = std::atomic_ref<unsigned>(*m_cqHead).load(std::memory_order_relaxed);
+            unsigned tail = std::atomic_ref<unsigned>(*m_cqTail).load(std::memory_order_acquire);
+            if (head == tail) {
+                // completions which didn't fit into the ring are kept by kernel until asked for
+                if (!(std::atomic_ref<unsigned>(*m_sqFlags).load(std::memory_order_relaxed) & IORING_SQ_CQ_OVERFLOW)
+                        || ::syscall(__NR_io_uring_enter, m_ringFd, 0, 0, IORING_ENTER_GETEVENTS, nullptr, 0) < 0) {
+                    break;
+                }
+                continue;
+            }
+
+            io_uring_cqe cqe = m_cqes[head & m_cqMask];
+            // releasing slot before resuming anybody, so they can submit more
+            std::atomic_ref<unsigned>(*m_cqHead).store(head + 1, std::memory_order_release);
+
+            // user_data == 0 — completion of cancellation request itself
+            if (cqe.user_data) {
+                complete(reinterpret_cast<FileOperation*>(cqe.user_data), cqe.res);
+            }
+        }
+    }
+
+    int m_ringFd = -1;
+    int m_eventFd = -1;
+
+    void *m_ring = MAP_FAILED;
+    size_t m_ringSize = 0;
+    io_uring_sqe *m_sqes = nullptr;
+    size_t m_sqesSize = 0;
+
+    unsigned *m_sqHead = nullptr;
+    unsigned *m_sqTail = nullptr;
+    unsigned *m_sqFlags = nullptr;
+    unsigned *m_sqArray = nullptr;
+    unsigned m_sqMask = 0;
+    unsigned m_sqEntries = 0;
+    unsigned m_sqLocalTail = 0;
+    bool m_submitScheduled = false;
+
+    unsigned *m_cqHead = nullptr;
+    unsigned *m_cqTail = nullptr;
+    unsigned m_cqMask = 0;
+    io_uring_cqe *m_cqes = nullptr;
+
+    char *m_fixedRegion = nullptr;
+    BufferPool *m_fixedPool = nullptr;
+
+    std::unique_ptr<QSocketNotifier> m_notifier;
+#endif
+
+    WaiterList m_inFlight;
+    const std::shared_ptr<RegistryLock> m_lock;
+    // context for completions, lives in the thread of the queue
+    QObject m_context;
+};
+
+/*
+ * common part of file operation awaiters
+ */
+struct FileOperationAwaiter
+{
+    FileOperationAwaiter() = default;
+
+    FileOperationAwaiter(FileOperationAwaiter &&other) noexcept
+        : m_op(std::exchange(other.m_op, nullptr))
+    {}
+
+    ~FileOperationAwaiter()
+    {
+        if (m_op) {
+            // still in flight — coroutine was aborted, maybe in another thread than the operation's queue
+            FileIOQueue::orphan(m_lock, m_queue, m_op);
+        }
+    }
+
+    bool await_ready() const
+    {
+        return false;
+    }
+
+protected:
+    FileOperation *prepare(std::coroutine_handle<> untypedHandle)
+    {
+        m_queue = &FileIOQueue::local();
+        m_lock = m_queue->lock();
+        m_op = new FileOperation;
+        m_op->handle = untypedHandle;
+        return m_op;
+    }
+
+    /*
+     * operation is completed, taking it back
+     */
+    std::unique_ptr<FileOperation> finish()
+    {
+        return std::unique_ptr<FileOperation>(std::exchange(m_op, nullptr));
+    }
+
+    FileOperation *m_op = nullptr;
+    // of the thread operation was started in, owner may be moved elsewhere since
+    FileIOQueue *m_queue = nullptr;
+    std::shared_ptr<RegistryLock> m_lock;
+};
+
+/*
+ * `co_await readAt(fd, offset, size)` — result is shorter than `size` at the end of file,
+ * empty on error
+ */
+struct FileReadAwaiter : FileOperationAwaiter
+{
+    FileReadAwaiter(int fd, qint64 offset, qint64 size)
+        : m_fd(fd)
+        , m_offset(offset)
+        , m_size(size)
+    {}
+
+    bool await_ready() const
+    {
+        return m_fd < 0 || m_size <= 0;
+    }
+
+    bool await_suspend(std::coroutine_handle<> untypedHandle)
+    {
+        FileOperation *op = prepare(untypedHandle);
+        return m_queue->read(op, m_fd, m_offset, m_size);
+    }
+
+    PooledBuffer await_resume()
+    {
+        std::unique_ptr<FileOperation> op = finish();
+        if (!op || op->result < 0) {
+#ifdef COSIGNAL_DEBUG
+            if (op) {
+                qDebug() << "file read failed:" << -op->result;
+            }
+#endif
+            return {};
+        }
+
+        op->buffer.setSize(op->result);
+        return std::move(op->buffer);
+    }
+
+private:
+    int m_fd;
+    qint64 m_offset;
+    qint64 m_size;
+};
+
+/*
+ * `co_await readFile(path)` — whole file or errno
+ */
+struct WholeFileReadAwaiter : FileOperationAwaiter
+{
+    // takes ownership of `fd`, negative one is -errno of opening it
+    WholeFileReadAwaiter(int fd, qint64 sizeHint)
+        : m_fd(fd)
+        , m_sizeHint(sizeHint)
+    {}
+
+    WholeFileReadAwaiter(WholeFileReadAwaiter &&other) noexcept
+        : FileOperationAwaiter(std::move(other))
+        , m_fd(std::exchange(other.m_fd, -EBADF))
+        , m_sizeHint(other.m_sizeHint)
+    {}
+
+    ~WholeFileReadAwaiter()
+    {
+        // never got to `co_await`
+        if (m_fd >= 0) {
+            ::close(m_fd);
+        }
+    }
+
+    bool await_ready() const
+    {
+        return m_fd < 0;
+    }
+
+    bool await_suspend(std::coroutine_handle<> untypedHandle)
+    {
+        FileOperation *op = prepare(untypedHandle);
+        op->ownedFd = std::exchange(m_fd, -EBADF);
+        return m_queue->readWhole(op, op->ownedFd, m_sizeHint);
+    }
+
+    Expected<PooledBuffer, int> await_resume()
+    {
+        std::unique_ptr<FileOperation> op = finish();
+        if (!op) {
+            // failed to open
+            return Unexpected{-m_fd};
+        }
+        if (op->result < 0) {
+            return Unexpected{int(-op->result)};
+        }
+
+        op->buffer.setSize(op->result);
+        return std::move(op->buffer);
+    }
+
+private:
+    int m_fd;
+    qint64 m_sizeHint;
+};
+
+/*
+ * `co_await writeAt(fd, offset, data)` — returns number of written bytes or -errno
+ * (`data` is implicitly shared, so it's not copied and stays alive while it's needed)
+ */
+struct FileWriteAwaiter : FileOperationAwaiter
+{
+    FileWriteAwaiter(int fd, qint64 offset, QByteArray data)
+        : m_fd(fd)
+        , m_offset(offset)
+        , m_data(std::move(data))
+    {}
+
+    bool await_suspend(std::coroutine_handle<> untypedHandle)
+    {
+        FileOperation *op = prepare(untypedHandle);
+        op->data = std::move(m_data);
+        return m_queue->write(op, m_fd, m_offset);
+    }
+
+    qint64 await_resume()
+    {
+        return finish()->result;
+    }
+
+private:
+    int m_fd;
+    qint64 m_offset;
+    QByteArray m_data;
+};
+
+inline FileReadAwaiter readAt(int fd, qint64 offset, qint64 size)
+{
+    return FileReadAwaiter(fd, offset, size);
+}
+
+inline FileWriteAwaiter writeAt(int fd, qint64 offset, QByteArray data)
+{
+    return FileWriteAwaiter(fd, offset, std::move(data));
+}
+
+/*
+ * `co_await readFile(path)` — whole file, read chunk after chunk until the end
+ * (so files without size, like ones in procfs, are read too), or errno
+ *
+ * opening and stat-ing is done synchronously, these are cheap compared to reading
+ */
+inline WholeFileReadAwaiter readFile(const QString &path)
+{
+    int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return WholeFileReadAwaiter(-errno, 0);
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) < 0) {
+        int error = errno;
+        ::close(fd);
+        return WholeFileReadAwaiter(-error, 0);
+    }
+
+    return WholeFileReadAwaiter(fd, S_ISREG(st.st_mode) ? st.st_size : 0);
+}
+
+// =============================================================================
+
+/*
+ * per-thread registry of fd readiness notifiers (see readable() and writable())
+ *
+ * one QSocketNotifier per fd and direction, shared by every coroutine waiting on it
+ * and enabled only while somebody is waiting, idle ones are deleted on the next event loop pass
+ * (so steady ping-pong doesn't recreate them, but closed fd-s don't keep them forever)
+ */
+class FdNotifiers
+{
+public:
+    struct Watch
+    {
+        std::unique_ptr<QSocketNotifier> notifier;
+        WaiterList waiters;
+    };
+
+    static FdNotifiers &local()
+    {
+        thread_local FdNotifiers notifiers;
+        return notifiers;
+    }
+
+    FdNotifiers(const FdNotifiers &) = delete;
+    FdNotifiers &operator=(const FdNotifiers &) = delete;
+
+    const std::shared_ptr<RegistryLock> &lock() const
+    {
+        return m_lock;
+    }
+
+    Watch *add(int fd, QSocketNotifier::Type type, WaiterNode *waiter)
+    {
+        Watch *&watch = m_watches[(quint64(quint32(fd)) << 2) | quint64(type)];
+        if (!watch) {
+            watch = new Watch;
+            watch->notifier.reset(new QSocketNotifier(fd, type));
+            QObject::connect(watch->notifier.get(), &QSocketNotifier::activated, &m_context, [this, watch = watch] {
+                activated(watch);
+            });
+        }
+
+        // waiter of moved owner may be unlinking itself (and posting a sweep) at the very moment
+        std::lock_guard guard(m_lock->mutex);
+        watch->waiters.push_back(waiter);
+        watch->notifier->setEnabled(true);
+        return watch;
+    }
+
+    /*
+     * from any thread — coroutine may be aborted in the thread its' owner was moved to,
+     * notifiers belong to the registry's thread though, so idle ones are disabled there
+     */
+    static void remove(const std::shared_ptr<RegistryLock> &lock, FdNotifiers *notifiers, Watch *watch, WaiterNode *waiter)
+    {
+        std::unique_lock guard(lock->mutex);
+        // otherwise it was already resumed (or registry is gone and has unlinked everything)
+        if (!waiter->linked) {
+            return;
+        }
+
+        watch->waiters.remove(waiter);
+        if (!watch->waiters.empty()) {
+            return;
+        }
+
+        if (lock->inRegistryThread()) {
+            guard.unlock();
+            watch->notifier->setEnabled(false);
+            notifiers->scheduleSweep();
+        } else {
+            // watch may be gone by the time it's delivered, sweep finds idle ones by itself
+            QMetaObject::invokeMethod(lock->context, [notifiers] { notifiers->sweep(); }, Qt::QueuedConnection);
+        }
+    }
+
+private:
+    FdNotifiers()
+        : m_lock(std::make_shared<RegistryLock>())
+    {
+        m_lock->context = &m_context;
+    }
+
+    ~FdNotifiers()
+    {
+        // thread is exiting, coroutines of owners moved elsewhere are woken up there (spuriously)
+        std::lock_guard guard(m_lock->mutex);
+        m_lock->context = nullptr;
+        for (Watch *watch : std::as_const(m_watches)) {
+            while (WaiterNode *waiter = watch->waiters.pop_front()) {
+                if (!waiter->handle) {
+                    continue;
+                }
+                std::coroutine_handle<CoroutineControllerBase<>>::from_address(waiter->handle.address())
+                    .promise().post_resume_if_moved();
+            }
+        }
+        qDeleteAll(m_watches);
+    }
+
+    void activated(Watch *watch)
+    {
+        // Qt's notifiers are level-triggered, this one is re-enabled only when somebody waits again
+        watch->notifier->setEnabled(false);
+
+        /*
+         * edge-style: every coroutine waiting at the moment is resumed once, in order of arrival,
+         * ones waiting again go to the next activation (aborted waiters unlink themselves, marker never is)
+         */
+        WaiterNode end;
+        std::unique_lock guard(m_lock->mutex);
+        watch->waiters.push_back(&end);
+        while (WaiterNode *waiter = watch->waiters.pop_front()) {
+            if (waiter == &end) {
+                break;
+            }
+            if (!waiter->handle) {
+                // marker of outer activation, when resumed coroutine runs nested event loop
+                continue;
+            }
+            if (std::coroutine_handle<CoroutineControllerBase<>>::from_address(waiter->handle.address())
+                    .promise().post_resume_if_moved()) {
+                continue;
+            }
+            // owner is in this thread, so nobody else can abort the coroutine now
+            guard.unlock();
+            waiter->handle.resume();
+            guard.lock();
+        }
+
+        if (watch->waiters.empty()) {
+            scheduleSweep();
+        }
+    }
+
+    void scheduleSweep()
+    {
+        if (!m_sweepScheduled) {
+            m_sweepScheduled = true;
+            QMetaObject::invokeMethod(&m_context, [this] { sweep(); }, Qt::QueuedConnection);
+        }
+    }
+
+    void sweep()
+    {
+        m_sweepScheduled = false;
+        std::lock_guard guard(m_lock->mutex);
+        for (auto it = m_watches.begin(); it != m_watches.end();) {
+            if (it.value()->waiters.empty()) {
+                delete it.value();
+                it = m_watches.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    QHash<quint64, Watch*> m_watches;
+    bool m_sweepScheduled = false;
+    const std::shared_ptr<RegistryLock> m_lock;
+    // context for activations and sweeps, lives in the thread of the registry
+    QObject m_context;
+};
+
+/*
+ * `co_await readable(fd)` / `co_await writable(fd)` — resumes once fd is ready
+ * (meant to be awaited after non-blocking read/write returned EAGAIN), aborting coroutine
+ * just unlinks it from fd's waiters
+ */
+struct FdReadyAwaiter : WaiterNode
+{
+    FdReadyAwaiter(int fd, QSocketNotifier::Type type)
+        : m_fd(fd)
+        , m_type(type)
+    {}
+
+    FdReadyAwaiter(FdReadyAwaiter &&other)
+        : WaiterNode()
+        , m_fd(other.m_fd)
+        , m_type(other.m_type)
+    {
+        // may be moved around only before being linked
+        Q_ASSERT(!other.linked);
+    }
+
+    ~FdReadyAwaiter()
+    {
+        // coroutine aborted while (or after) waiting
+        if (m_lock) {
+            FdNotifiers::remove(m_lock, m_notifiers, m_watch, this);
+        }
+    }
+
+    bool await_ready() const
+    {
+        // nothing to wait for, read/write will fail right away
+        return m_fd < 0;
+    }
+
+    void await_suspend(std::coroutine_handle<> untypedHandle)
+    {
+        handle = untypedHandle;
+        m_notifiers = &FdNotifiers::local();
+        m_lock = m_notifiers->lock();
+        m_watch = m_notifiers->add(m_fd, m_type, this);
+    }
+
+    void await_resume() {}
+
+private:
+    int m_fd;
+    QSocketNotifier::Type m_type;
+    // of the thread coroutine started waiting in, owner may be moved elsewhere since
+    FdNotifiers *m_notifiers = nullptr;
+    std::shared_ptr<RegistryLock> m_lock;
+    FdNotifiers::Watch *m_watch = nullptr;
+};
+
+inline FdReadyAwaiter readable(int fd)
+{
+    return FdReadyAwaiter(fd, QSocketNotifier::Read);
+}
+
+inline FdReadyAwaiter writable(int fd)
+{
+    return FdReadyAwaiter(fd, QSocketNotifier::Write);
+}
+
+#ifdef COSIGNAL_METRICS
+template<typename A>
+requires std::is_base_of_v<IODeviceAwaiter<A>, A> || std::is_base_of_v<FileOperationAwaiter, A>
+struct AwaitKindOf<A>
+{
+    static constexpr AwaitKind value = AwaitKind::IO;
+};
+
+template<>
+struct AwaitKindOf<FdReadyAwaiter>
+{
+    static constexpr AwaitKind value = AwaitKind::IO;
+};
+
+template<>
+struct AwaitKindOf<RunProcessAwaiter>
+{
+    static constexpr AwaitKind value = AwaitKind::Process;
+};
+
+template<>
+struct AwaitKindOf<ProcessStream::NextAwaiter>
+{
+    static constexpr AwaitKind value = AwaitKind::Process;
+};
+#endif
@@ -0,0 +1,710 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include <QThread>
+#include <QPromise>
+
+#include "qcosignal.hpp"
+
+/*
+ * thread-agnostic coroutines for CPU-bound work
+ *
+ *   Job<qint64> sum(JobExecutor &executor, const int *data, int size)
+ *   {
+ *     if (size < 4096) {
+ *       co_return std::accumulate(data, data + size, qint64(0));
+ *     }
+ *     Job<qint64> left = sum(executor, data, size / 2);
+ *     Job<qint64> right = sum(executor, data + size / 2, size - size / 2);
+ *     co_return co_await left + co_await right;
+ *   }
+ *
+ * unlike Async<T> jobs aren't bound to any QObject or thread — every job is scheduled
+ * on a work-stealing pool, and can be `co_await`-ed either by another job or by
+ * regular Async<T> coroutine (which is resumed back in its' owner thread)
+ *
+ * jobs can `co_await` only other jobs
+ *
+ * kept in separate header, same as I/O stuff
+ */
+
+class JobExecutor;
+
+template<typename T = void>
+struct Job;
+
+template<typename T>
+struct JobController;
+
+// =============================================================================
+
+/*
+ * someone waiting for the job to finish — either parent job or Async<T> coroutine
+ */
+struct JobWaiter
+{
+    // returns coroutine to transfer control to (if any)
+    virtual std::coroutine_handle<> wake() = 0;
+
+protected:
+    ~JobWaiter() = default;
+};
+
+/*
+ * state shared between job's frame and its' Job<T> objects
+ * lives until both of them are gone
+ */
+struct JobStateBase
+{
+    // `nullptr` — running, `Finished` — done (or canceled), anything else — somebody waits
+    inline static JobWaiter *const Finished = reinterpret_cast<JobWaiter*>(1);
+
+    std::atomic<JobWaiter*> waiter = nullptr;
+
+    // set when job has run to the end, i.e. there is a result
+    bool completed = false;
+
+    std::atomic<bool> canceled = false;
+    // job, that was running when this one was created — cancellation is inherited from it
+    std::shared_ptr<JobStateBase> parent;
+
+    bool isFinished() const
+    {
+        return waiter.load(std::memory_order_acquire) == Finished;
+    }
+
+    bool isCanceled() const
+    {
+        for (const JobStateBase *state = this; state; state = state->parent.get()) {
+            if (state->canceled.load(std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /*
+     * marks job as finished and wakes up whoever waits for it
+     * job's frame is already destroyed at this point
+     */
+    std::coroutine_handle<> finish()
+    {
+        JobWaiter *waiter = this->waiter.exchange(Finished, std::memory_order_acq_rel);
+        if (waiter) {
+            return waiter->wake();
+        }
+        return std::noop_coroutine();
+    }
+};
+
+template<typename T>
+struct JobState : JobStateBase
+{
+    std::optional<std::conditional_t<std::is_void_v<T>, bool, T>> result;
+
+    /*
+     * Async<T> coroutine waiting for the job from its' owner thread
+     * is woken up via QFuture continuation, which Qt delivers to the right thread
+     * (and doesn't deliver at all, if owner is gone by then)
+     */
+    struct OwnerWaiter : JobWaiter
+    {
+        std::coroutine_handle<> wake() override
+        {
+            promise.finish();
+            return std::noop_coroutine();
+        }
+
+        QPromise<void> promise;
+    };
+
+    std::optional<OwnerWaiter> ownerWaiter;
+};
+
+// =============================================================================
+
+/*
+ * part of job's promise, not depending on result type
+ */
+struct JobControllerBase
+{
+    // state of the job being executed by current thread, parent of newly created jobs
+    static inline thread_local std::shared_ptr<JobStateBase> t_running;
+
+    JobExecutor *m_executor = nullptr;
+    std::coroutine_handle<> m_handle;
+    std::shared_ptr<JobStateBase> m_stateBase;
+
+    bool isCanceled() const
+    {
+        return m_stateBase->isCanceled();
+    }
+
+    /*
+     * destroys suspended frame of canceled job instead of resuming it
+     * waiting parent job (if any) will be canceled the same way
+     */
+    std::coroutine_handle<> cancel()
+    {
+        std::shared_ptr<JobStateBase> state = m_stateBase;
+        m_handle.destroy();
+        // `this` is gone
+        return state->finish();
+    }
+
+    void resumed()
+    {
+        t_running = m_stateBase;
+    }
+};
+
+/*
+ * pool of worker threads, each with its' own deque of jobs
+ *
+ * jobs created by a worker are pushed to the back of its' deque and popped
+ * from there (LIFO — freshest job has the hottest data), idle workers steal
+ * from the front of others' deques (FIFO — oldest job is usually the biggest
+ * chunk of work)
+ *
+ * deques are guarded by mutexes, which are uncontended unless somebody steals
+ */
+class JobExecutor
+{
+public:
+    explicit JobExecutor(int threads = QThread::idealThreadCount())
+    {
+        threads = qMax(threads, 1);
+        for (int i = 0; i < threads; ++i) {
+            m_workers.push_back(std::make_unique<Worker>());
+            m_workers.back()->executor = this;
+            m_workers.back()->seed = quint32(i) * 2654435761u + 1;
+        }
+        for (std::unique_ptr<Worker> &worker : m_workers) {
+            worker->thread = std::thread([this, worker = worker.get()] { run(*worker); });
+        }
+    }
+
+    /*
+     * jobs left in queues are canceled, so is everybody waiting for them
+     */
+    ~JobExecutor()
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            m_stopping = true;
+        }
+        m_wakeup.notify_all();
+        for (std::unique_ptr<Worker> &worker : m_workers) {
+            worker->thread.join();
+        }
+
+        for (std::unique_ptr<Worker> &worker : m_workers) {
+            cancelAll(worker->jobs);
+        }
+        cancelAll(m_injected);
+    }
+
+    JobExecutor(const JobExecutor &) = delete;
+    JobExecutor &operator=(const JobExecutor &) = delete;
+
+    static JobExecutor &global()
+    {
+        static JobExecutor executor;
+        return executor;
+    }
+
+    /*
+     * executor of the calling worker thread, global one for any other thread
+     */
+    static JobExecutor &current()
+    {
+        return t_worker ? *t_worker->executor : global();
+    }
+
+    int threadCount() const
+    {
+        return int(m_workers.size());
+    }
+
+    void schedule(JobControllerBase *job)
+    {
+        if (t_worker && t_worker->executor == this) {
+            std::lock_guard lock(t_worker->mutex);
+            t_worker->jobs.push_back(job);
+        } else {
+            std::lock_guard lock(m_mutex);
+            m_injected.push_back(job);
+        }
+
+        // seq_cst pair with sleeping worker's check of `m_queued`, so wakeup isn't lost
+        m_queued.fetch_add(1);
+        if (m_sleeping.load() > 0) {
+            std::lock_guard lock(m_mutex);
+            m_wakeup.notify_one();
+        }
+    }
+
+private:
+    struct Worker
+    {
+        JobExecutor *executor = nullptr;
+        std::mutex mutex;
+        std::deque<JobControllerBase*> jobs;
+        std::thread thread;
+        // for picking victims
+        quint32 seed = 1;
+    };
+
+    void run(Worker &worker)
+    {
+        t_worker = &worker;
+
+        while (true) {
+            JobControllerBase *job = popLocal(worker);
+            if (!job) {
+                job = popInjected();
+            }
+            if (!job) {
+                job = steal(worker);
+            }
+
+            if (job) {
+                m_queued.fetch_sub(1);
+                execute(job);
+                continue;
+            }
+
+            std::unique_lock lock(m_mutex);
+            if (m_stopping) {
+                break;
+            }
+            m_sleeping.fetch_add(1);
+            m_wakeup.wait(lock, [this] { return m_stopping || m_queued.load() > 0; });
+            m_sleeping.fetch_sub(1);
+            if (m_stopping) {
+                break;
+            }
+        }
+
+        JobControllerBase::t_running.reset();
+        t_worker = nullptr;
+    }
+
+    static void execute(JobControllerBase *job)
+    {
+        /*
+         * everything else (children, parents awaiting them) is run from here
+         * via symmetric transfer, without returning to the loop
+         */
+        if (job->isCanceled()) {
+            job->cancel().resume();
+        } else {
+            job->m_handle.resume();
+        }
+    }
+
+    JobControllerBase *popLocal(Worker &worker)
+    {
+        std::lock_guard lock(worker.mutex);
+        if (worker.jobs.empty()) {
+            return nullptr;
+        }
+        JobControllerBase *job = worker.jobs.back();
+        worker.jobs.pop_back();
+        return job;
+    }
+
+    JobControllerBase *popInjected()
+    {
+        std::lock_guard lock(m_mutex);
+        if (m_injected.empty()) {
+            return nullptr;
+        }
+        JobControllerBase *job = m_injected.front();
+        m_injected.pop_front();
+        return job;
+    }
+
+    JobControllerBase *steal(Worker &thief)
+    {
+        const int count = int(m_workers.size());
+        if (count < 2) {
+            return nullptr;
+        }
+
+        // xorshift, starting from random victim
+        thief.seed ^= thief.seed << 13;
+        thief.seed ^= thief.seed >> 17;
+        thief.seed ^= thief.seed << 5;
+        const int start = int(thief.seed % quint32(count));
+
+        for (int i = 0; i < count; ++i) {
+            Worker &victim = *m_workers[(start + i) % count];
+            if (&victim == &thief) {
+                continue;
+            }
+            std::lock_guard lock(victim.mutex);
+            if (!victim.jobs.empty()) {
+                JobControllerBase *job = victim.jobs.front();
+                victim.jobs.pop_front();
+                return job;
+            }
+        }
+        return nullptr;
+    }
+
+    static void cancelAll(std::deque<JobControllerBase*> &jobs)
+    {
+        while (!jobs.empty()) {
+            JobControllerBase *job = jobs.front();
+            jobs.pop_front();
+            job->cancel().resume();
+        }
+    }
+
+    static inline thread_local Worker *t_worker = nullptr;
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+
+    // guards `m_injected`, `m_stopping` and sleeping
+    std::mutex m_mutex;
+    std::condition_variable m_wakeup;
+    std::deque<JobControllerBase*> m_injected;
+    bool m_stopping = false;
+
+    // jobs sitting in any of the queues
+    std::atomic<qint64> m_queued = 0;
+    std::atomic<int> m_sleeping = 0;
+};
+
+// =============================================================================
+
+/*
+ * job awaiting another job — no threads involved, finishing child transfers
+ * control right into the parent, on the same worker
+ */
+template<typename U>
+struct JobJoinAwaiter : JobWaiter
+{
+    JobJoinAwaiter(std::shared_ptr<JobState<U>> child, JobControllerBase *parent)
+        : m_child(std::move(child))
+        , m_parent(parent)
+    {}
+
+    bool await_ready() const
+    {
+        return m_child->isFinished() && m_child->completed && !m_parent->isCanceled();
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<>)
+    {
+        if (m_parent->isCanceled()) {
+            return m_parent->cancel();
+        }
+
+        JobWaiter *expected = nullptr;
+        if (m_child->waiter.compare_exchange_strong(expected, this, std::memory_order_acq_rel)) {
+            // worker will pick something else (most likely the child itself)
+            return std::noop_coroutine();
+        }
+
+        // finished already
+        Q_ASSERT(expected == JobStateBase::Finished);
+        return m_child->completed ? m_parent->m_handle : m_parent->cancel();
+    }
+
+    std::coroutine_handle<> wake() override
+    {
+        // canceled child has no result, so parent can't go on either
+        if (!m_child->completed || m_parent->isCanceled()) {
+            return m_parent->cancel();
+        }
+        return m_parent->m_handle;
+    }
+
+    template<typename Dummy = U>
+    requires std::is_void_v<U>
+    void await_resume()
+    {
+        m_parent->resumed();
+    }
+
+    template<typename Dummy = U>
+    requires (!std::is_void_v<U>)
+    U await_resume()
+    {
+        m_parent->resumed();
+        return std::move(*m_child->result);
+    }
+
+private:
+    std::shared_ptr<JobState<U>> m_child;
+    JobControllerBase *m_parent;
+};
+
+/*
+ * job's promise, see CoroutineControllerBase for the naming
+ */
+template<typename T>
+struct JobControllerCommon : JobControllerBase
+{
+    /*
+     * first `JobExecutor&` argument of the job function (if any) picks the executor,
+     * otherwise it's the one of current worker (or global)
+     */
+    template<typename... Args>
+    JobControllerCommon(Args &...args)
+        : m_state(std::make_shared<JobState<T>>())
+    {
+        ((m_executor = m_executor ? m_executor : pickExecutor(args)), ...);
+        if (!m_executor) {
+            m_executor = &JobExecutor::current();
+        }
+
+        m_stateBase = m_state;
+        m_state->parent = t_running;
+    }
+
+    template<typename A>
+    static JobExecutor *pickExecutor(A &)
+    {
+        return nullptr;
+    }
+
+    static JobExecutor *pickExecutor(JobExecutor &executor)
+    {
+        return &executor;
+    }
+
+    struct ScheduleAwaiter
+    {
+        JobControllerCommon *job;
+
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<>) noexcept
+        {
+            // may start running on another thread right away, so not touching anything after
+            job->m_executor->schedule(job);
+        }
+
+        void await_resume() noexcept
+        {
+            job->resumed();
+        }
+    };
+
+    struct FinalAwaiter
+    {
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> handle) noexcept
+        {
+            JobController<T> &job = std::coroutine_handle<JobController<T>>::from_address(handle.address()).promise();
+            std::shared_ptr<JobState<T>> state = job.m_state;
+            state->completed = true;
+            handle.destroy();
+            return state->finish();
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    inline ScheduleAwaiter initial_suspend() noexcept { return {this}; }
+
+    inline FinalAwaiter final_suspend() noexcept { return {}; }
+
+    inline static void unhandled_exception() noexcept
+    {
+        Q_ASSERT_X(false, __PRETTY_FUNCTION__, "not supported");
+        std::abort();
+    }
+
+    template<typename U>
+    JobJoinAwaiter<U> await_transform(Job<U> &&job)
+    {
+        return JobJoinAwaiter<U>(job.m_state, this);
+    }
+
+    template<typename U>
+    JobJoinAwaiter<U> await_transform(Job<U> &job)
+    {
+        return JobJoinAwaiter<U>(job.m_state, this);
+    }
+
+    std::shared_ptr<JobState<T>> m_state;
+};
+
+template<typename T>
+struct JobController : JobControllerCommon<T>
+{
+    template<typename... Args>
+    JobController(Args &...args)
+        : JobControllerCommon<T>(args...)
+    {
+        this->m_handle = std::coroutine_handle<JobController>::from_promise(*this);
+    }
+
+    inline Job<T> get_return_object() noexcept { return Job<T>(this->m_state); }
+
+    inline void return_value(T&& v) noexcept
+    {
+        this->m_state->result.emplace(std::forward<T>(v));
+    }
+
+    inline void return_value(const T& v) noexcept
+    {
+        this->m_state->result.emplace(v);
+    }
+};
+
+template<>
+struct JobController<void> : JobControllerCommon<void>
+{
+    template<typename... Args>
+    JobController(Args &...args)
+        : JobControllerCommon<void>(args...)
+    {
+        m_handle = std::coroutine_handle<JobController>::from_promise(*this);
+    }
+
+    inline Job<> get_return_object() noexcept;
+
+    inline void return_void() noexcept
+    {
+        m_state->result.emplace(true);
+    }
+};
+
+// =============================================================================
+
+/*
+ * publicly visible job type
+ *
+ * `co_await`-ing it from Async<T> coroutine suspends the latter until job is done,
+ * if coroutine is aborted meanwhile (i.e. its' owner is destroyed) — job is canceled,
+ * together with all the jobs it's waiting for, at their next `co_await`
+ *
+ * dropping unfinished Job also cancels it
+ */
+template<typename T>
+struct Job
+{
+    using promise_type = JobController<T>;
+
+    Job(std::shared_ptr<JobState<T>> state)
+        : m_state(std::move(state))
+    {}
+
+    Job(Job &&) = default;
+    Job &operator=(Job &&) = default;
+
+    ~Job()
+    {
+        if (m_handle) {
+            // awaiting coroutine is gone, nothing to resume
+            *m_handle = nullptr;
+        }
+        if (m_state && !m_state->isFinished()) {
+            m_state->canceled.store(true, std::memory_order_relaxed);
+        }
+    }
+
+    void cancel()
+    {
+        m_state->canceled.store(true, std::memory_order_relaxed);
+    }
+
+    /*
+     * awaiting from Async<T> coroutine
+     */
+    bool await_ready() const
+    {
+        return m_state->isFinished() && m_state->completed;
+    }
+
+    bool await_suspend(std::coroutine_handle<> untypedHandle)
+    {
+        // same assumption as everywhere else — awaited by CoroutineController<X>
+        Handle& handle = reinterpret_cast<Handle&>(untypedHandle);
+
+        m_handle = std::make_shared<std::coroutine_handle<>>(untypedHandle);
+
+        typename JobState<T>::OwnerWaiter &waiter = m_state->ownerWaiter.emplace();
+        waiter.promise.start();
+        waiter.promise.future().then(
+            handle.promise().m_object,
+            [handle = m_handle, state = std::weak_ptr<JobState<T>>(m_state)] {
+                std::shared_ptr<JobState<T>> job = state.lock();
+                if (!*handle || !job) {
+                    return;
+                }
+                if (job->completed) {
+                    handle->resume();
+                } else {
+#ifdef COSIGNAL_DEBUG
+                    qDebug() << "aborting coroutine because awaited job was canceled";
+#endif
+                    reinterpret_cast<Handle&>(*handle).promise().abort(AbortReason::Other);
+                }
+            }
+        );
+
+        JobWaiter *expected = nullptr;
+        if (m_state->waiter.compare_exchange_strong(expected, &waiter, std::memory_order_acq_rel)) {
+            return true;
+        }
+
+        /*
+         * finished in between — continuation will sort it out,
+         * same as if job had finished after suspending
+         */
+        waiter.wake();
+        return true;
+    }
+
+    template<typename Dummy = T>
+    requires std::is_void_v<T>
+    void await_resume()
+    {
+        return;
+    }
+
+    template<typename Dummy = T>
+    requires (!std::is_void_v<T>)
+    T await_resume()
+    {
+        return std::move(*m_state->result);
+    }
+
+    std::shared_ptr<JobState<T>> m_state;
+    // shared with continuation, same as in FutureAwaiter
+    std::shared_ptr<std::coroutine_handle<>> m_handle;
+};
+
+inline Job<> JobController<void>::get_return_object() noexcept
+{
+    return Job<>(m_state);
+}
+
+#ifdef COSIGNAL_METRICS
+template<typename T>
+struct AwaitKindOf<Job<T>>
+{
+    static constexpr AwaitKind value = AwaitKind::Job;
+};
+#endif
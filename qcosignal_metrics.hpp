@@ -0,0 +1,332 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+#include <QtGlobal>
+
+#include "qcosignal_abort.hpp"
+
+/*
+ * always-on metrics of coroutine machinery, compiled in with COSIGNAL_METRICS
+ * (included by qcosignal.hpp itself, no need to include it directly)
+ *
+ *   CoroutineMetrics::Snapshot snapshot = CoroutineMetrics::snapshot();
+ *   qint64 p99 = snapshot.signalLatency.percentile(0.99);
+ *   qint64 aborts = snapshot.aborted[int(AbortReason::SenderDestroyed)];
+ *
+ * every thread records into its' own set of histograms and counters (no locks, no atomic
+ * read-modify-writes, no allocations after the first record), `snapshot()` merges all of them
+ *
+ * all durations are in nanoseconds
+ */
+
+/*
+ * what coroutine was suspended on, see AwaitKindOf
+ */
+enum class AwaitKind
+{
+    Signal,
+    AnyOf,
+    Future,
+    Coroutine,
+    Generator,
+    IO,
+    Process,
+    Job,
+    Other,
+
+    Count
+};
+
+/*
+ * awaitable type -> AwaitKind, specialized next to the awaitables themselves
+ */
+template<typename A>
+struct AwaitKindOf
+{
+    static constexpr AwaitKind value = AwaitKind::Other;
+};
+
+// =============================================================================
+
+/*
+ * log-linear histogram: every power of two is split into 8 linear sub-buckets,
+ * so any recorded value is off by no more than 12.5%, whole qint64 range fits in 496 buckets
+ *
+ * plain value, used for snapshots and merging
+ */
+struct LatencyHistogram
+{
+    static constexpr int SubBucketBits = 3;
+    static constexpr int SubBuckets = 1 << SubBucketBits;
+    static constexpr int BucketCount = (64 - SubBucketBits + 1) * SubBuckets;
+
+    static int bucketOf(qint64 value)
+    {
+        const quint64 v = quint64(qMax<qint64>(value, 0));
+        if (v < SubBuckets) {
+            return int(v);
+        }
+        const int exponent = 63 - std::countl_zero(v);
+        const int sub = int(v >> (exponent - SubBucketBits)) & (SubBuckets - 1);
+        return (exponent - SubBucketBits + 1) * SubBuckets + sub;
+    }
+
+    // highest value falling into the bucket
+    static qint64 bucketValue(int bucket)
+    {
+        if (bucket < SubBuckets) {
+            return bucket;
+        }
+        const int exponent = bucket / SubBuckets + SubBucketBits - 1;
+        const quint64 sub = quint64(bucket % SubBuckets);
+        return qint64((((SubBuckets + sub + 1) << (exponent - SubBucketBits)) - 1) & quint64(std::numeric_limits<qint64>::max()));
+    }
+
+    void merge(const LatencyHistogram &other)
+    {
+        for (int i = 0; i < BucketCount; ++i) {
+            buckets[i] += other.buckets[i];
+        }
+        count += other.count;
+        sum += other.sum;
+        max = qMax(max, other.max);
+    }
+
+    /*
+     * value below which `fraction` of recorded values are (0.5 — median, 0.99 — p99)
+     */
+    qint64 percentile(double fraction) const
+    {
+        if (count == 0) {
+            return 0;
+        }
+        const quint64 rank = qMax<quint64>(quint64(fraction * count + 0.5), 1);
+        quint64 seen = 0;
+        for (int i = 0; i < BucketCount; ++i) {
+            seen += buckets[i];
+            if (seen >= rank) {
+                return qMin(bucketValue(i), max);
+            }
+        }
+        return max;
+    }
+
+    qint64 mean() const
+    {
+        return count ? sum / qint64(count) : 0;
+    }
+
+    std::array<quint64, BucketCount> buckets = {};
+    quint64 count = 0;
+    qint64 sum = 0;
+    qint64 max = 0;
+};
+
+struct CoroutineMetrics
+{
+    struct Snapshot
+    {
+        /*
+         * from signal emission to resume of awaiting coroutine: CrossThread emissions are stamped
+         * in sender's thread, so the hop into owner's thread is included, others — when delivered
+         * to the slot in owner's thread (time spent by queued connection's event in the queue isn't)
+         */
+        LatencyHistogram signalLatency;
+        // from QFuture finishing (in whatever thread) to resume of awaiting coroutine
+        LatencyHistogram futureLatency;
+        // from frame creation to completion or abort
+        LatencyHistogram frameLifetime;
+        // how long coroutines stay suspended, per awaitable kind
+        std::array<LatencyHistogram, int(AwaitKind::Count)> suspension;
+
+        qint64 created = 0;
+        qint64 completed = 0;
+        std::array<qint64, int(AbortReason::Count)> aborted = {};
+
+        void merge(const Snapshot &other)
+        {
+            signalLatency.merge(other.signalLatency);
+            futureLatency.merge(other.futureLatency);
+            frameLifetime.merge(other.frameLifetime);
+            for (int i = 0; i < int(AwaitKind::Count); ++i) {
+                suspension[i].merge(other.suspension[i]);
+            }
+            created += other.created;
+            completed += other.completed;
+            for (std::size_t i = 0; i < aborted.size(); ++i) {
+                aborted[i] += other.aborted[i];
+            }
+        }
+    };
+
+    static qint64 now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()
+        ).count();
+    }
+
+    /*
+     * merged metrics of all the threads, including already finished ones
+     */
+    static Snapshot snapshot()
+    {
+        Registry &registry = Registry::instance();
+        std::lock_guard lock(registry.mutex);
+
+        Snapshot result = registry.retired;
+        for (const Recorder *recorder : registry.recorders) {
+            result.merge(recorder->snapshot());
+        }
+        return result;
+    }
+
+    // =========================================================================
+
+    static void signalResumed(qint64 emittedAt)
+    {
+        recorder().signalLatency.record(now() - emittedAt);
+    }
+
+    static void futureResumed(qint64 finishedAt)
+    {
+        recorder().futureLatency.record(now() - finishedAt);
+    }
+
+    static void suspended(AwaitKind kind, qint64 suspendedAt)
+    {
+        recorder().suspension[int(kind)].record(now() - suspendedAt);
+    }
+
+    static void created()
+    {
+        bump(recorder().created);
+    }
+
+    static void completed(qint64 createdAt)
+    {
+        Recorder &r = recorder();
+        bump(r.completed);
+        r.frameLifetime.record(now() - createdAt);
+    }
+
+    static void aborted(AbortReason reason, qint64 createdAt)
+    {
+        Recorder &r = recorder();
+        bump(r.aborted[int(reason)]);
+        r.frameLifetime.record(now() - createdAt);
+    }
+
+private:
+    /*
+     * only owning thread writes, so plain load + store is enough,
+     * atomics are there just for `snapshot()` reading from another thread
+     */
+    static void bump(std::atomic<quint64> &counter, quint64 value = 1)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    struct HistogramRecorder
+    {
+        void record(qint64 value)
+        {
+            value = qMax<qint64>(value, 0);
+            bump(buckets[LatencyHistogram::bucketOf(value)]);
+            bump(count);
+            bump(sum, quint64(value));
+            if (quint64(value) > max.load(std::memory_order_relaxed)) {
+                max.store(quint64(value), std::memory_order_relaxed);
+            }
+        }
+
+        void addTo(LatencyHistogram &histogram) const
+        {
+            LatencyHistogram own;
+            for (int i = 0; i < LatencyHistogram::BucketCount; ++i) {
+                own.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+            }
+            own.count = count.load(std::memory_order_relaxed);
+            own.sum = qint64(sum.load(std::memory_order_relaxed));
+            own.max = qint64(max.load(std::memory_order_relaxed));
+            histogram.merge(own);
+        }
+
+        std::array<std::atomic<quint64>, LatencyHistogram::BucketCount> buckets = {};
+        std::atomic<quint64> count = 0;
+        std::atomic<quint64> sum = 0;
+        std::atomic<quint64> max = 0;
+    };
+
+    struct Recorder
+    {
+        Recorder()
+        {
+            Registry &registry = Registry::instance();
+            std::lock_guard lock(registry.mutex);
+            registry.recorders.push_back(this);
+        }
+
+        // finished thread's numbers are kept in `Registry::retired`
+        ~Recorder()
+        {
+            Registry &registry = Registry::instance();
+            std::lock_guard lock(registry.mutex);
+            registry.retired.merge(snapshot());
+            std::erase(registry.recorders, this);
+        }
+
+        Snapshot snapshot() const
+        {
+            Snapshot result;
+            signalLatency.addTo(result.signalLatency);
+            futureLatency.addTo(result.futureLatency);
+            frameLifetime.addTo(result.frameLifetime);
+            for (int i = 0; i < int(AwaitKind::Count); ++i) {
+                suspension[i].addTo(result.suspension[i]);
+            }
+            result.created = qint64(created.load(std::memory_order_relaxed));
+            result.completed = qint64(completed.load(std::memory_order_relaxed));
+            for (std::size_t i = 0; i < aborted.size(); ++i) {
+                result.aborted[i] = qint64(aborted[i].load(std::memory_order_relaxed));
+            }
+            return result;
+        }
+
+        HistogramRecorder signalLatency;
+        HistogramRecorder futureLatency;
+        HistogramRecorder frameLifetime;
+        std::array<HistogramRecorder, int(AwaitKind::Count)> suspension;
+
+        std::atomic<quint64> created = 0;
+        std::atomic<quint64> completed = 0;
+        std::array<std::atomic<quint64>, int(AbortReason::Count)> aborted = {};
+    };
+
+    struct Registry
+    {
+        static Registry &instance()
+        {
+            // never destroyed, thread_local recorders may outlive statics
+            static Registry *registry = new Registry;
+            return *registry;
+        }
+
+        std::mutex mutex;
+        std::vector<Recorder*> recorders;
+        Snapshot retired;
+    };
+
+    static Recorder &recorder()
+    {
+        static thread_local Recorder recorder;
+        return recorder;
+    }
+};
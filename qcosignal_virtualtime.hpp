@@ -0,0 +1,296 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+
+#include <QAbstractEventDispatcher>
+#include <QCoreApplication>
+#include <QFuture>
+#include <QPromise>
+#include <QRandomGenerator>
+#include <QThread>
+#include <QTimer>
+#include <QTimerEvent>
+#include <QtConcurrent>
+
+#include "qcosignal.hpp"
+
+/*
+ * deterministic virtual time for running coroutine scenarios in milliseconds
+ *
+ *   VirtualTimeDispatcher *dispatcher = new VirtualTimeDispatcher(seed);
+ *   QCoreApplication::setEventDispatcher(dispatcher); // before application is created
+ *   QCoreApplication app(argc, argv);
+ *   ...
+ *   QString result = co_await VirtualTime::run(&concurrent_with_result, 1);
+ *
+ * - main thread's clock only moves when there is nothing else to do: all posted events
+ *   (queued resumes, deleteLater-s) are processed first, then it jumps right to the next timer
+ * - timers due at the same time fire in random order, every (re)arm gets random jitter of up to
+ *   `jitterPercent` of interval, both drawn from generator seeded with `seed` — same seed,
+ *   same interleaving of timers, futures and resumes
+ * - `VirtualTime::run()` is `QtConcurrent::run()`, which under virtual time calls function right away
+ *   in the calling thread and finishes returned future after however long function `VirtualTime::sleep()`-ed
+ * - coroutines yielded (`yieldNow()`) by the same event loop pass are resumed in random order too,
+ *   the rest of posted events (deleteLater-s, queued invocations) keep Qt's usual FIFO order
+ *
+ * QElapsedTimer, QDeadlineTimer and other threads' event loops still use real clock,
+ * socket notifiers aren't supported — scenarios doing real I/O or threading need real time
+ */
+class VirtualTimeDispatcher : public QAbstractEventDispatcher
+{
+public:
+    explicit VirtualTimeDispatcher(quint32 seed, int jitterPercent = 10)
+        : m_random(seed)
+        , m_jitterPercent(jitterPercent)
+    {
+        current() = this;
+        YieldQueue::picker() = [] (quint32 count) {
+            return current()->pick(count);
+        };
+    }
+
+    ~VirtualTimeDispatcher()
+    {
+        YieldQueue::picker() = nullptr;
+        current() = nullptr;
+    }
+
+    static VirtualTimeDispatcher *&current()
+    {
+        static VirtualTimeDispatcher *dispatcher = nullptr;
+        return dispatcher;
+    }
+
+    // virtual ms passed since creation
+    qint64 now() const
+    {
+        return m_now;
+    }
+
+    // next scenario explores another interleaving
+    void reseed(quint32 seed)
+    {
+        m_random.seed(seed);
+    }
+
+    qint64 jittered(qint64 interval)
+    {
+        const qint64 jitter = qMin<qint64>(interval * m_jitterPercent / 100, std::numeric_limits<int>::max() - 1);
+        return interval + m_random.bounded(int(jitter) + 1);
+    }
+
+    // random index below `count`
+    quint32 pick(quint32 count)
+    {
+        return m_random.bounded(count);
+    }
+
+    bool processEvents(QEventLoop::ProcessEventsFlags flags) override
+    {
+        m_interrupted.store(false);
+        emit awake();
+
+        m_woken.store(false);
+        QCoreApplication::sendPostedEvents();
+        if (m_woken.load() || m_interrupted.load()) {
+            // more was posted meanwhile, time doesn't move until it's processed too
+            return true;
+        }
+
+        if (fireNextTimer()) {
+            return true;
+        }
+
+        if (!(flags & QEventLoop::WaitForMoreEvents)) {
+            return false;
+        }
+
+        // nothing is ever going to happen in virtual time, only another thread may post something
+        emit aboutToBlock();
+        std::unique_lock lock(m_mutex);
+        m_wakeUp.wait(lock, [this] { return m_woken.load() || m_interrupted.load(); });
+        return false;
+    }
+
+    void registerSocketNotifier(QSocketNotifier *) override
+    {
+        qWarning() << "socket notifiers aren't supported under virtual time";
+    }
+
+    void unregisterSocketNotifier(QSocketNotifier *) override
+    {}
+
+    void registerTimer(int timerId, qint64 interval, Qt::TimerType timerType, QObject *object) override
+    {
+        m_timers.append(Timer{timerId, interval, timerType, object, m_now + jittered(interval)});
+    }
+
+    bool unregisterTimer(int timerId) override
+    {
+        return m_timers.removeIf([timerId] (const Timer &timer) { return timer.id == timerId; }) > 0;
+    }
+
+    bool unregisterTimers(QObject *object) override
+    {
+        return m_timers.removeIf([object] (const Timer &timer) { return timer.object == object; }) > 0;
+    }
+
+    QList<TimerInfo> registeredTimers(QObject *object) const override
+    {
+        QList<TimerInfo> result;
+        for (const Timer &timer : m_timers) {
+            if (timer.object == object) {
+                result.append(TimerInfo(timer.id, int(timer.interval), timer.type));
+            }
+        }
+        return result;
+    }
+
+    int remainingTime(int timerId) override
+    {
+        for (const Timer &timer : m_timers) {
+            if (timer.id == timerId) {
+                return int(qMax<qint64>(timer.deadline - m_now, 0));
+            }
+        }
+        return -1;
+    }
+
+    void wakeUp() override
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            m_woken.store(true);
+        }
+        m_wakeUp.notify_one();
+    }
+
+    void interrupt() override
+    {
+        {
+            std::lock_guard lock(m_mutex);
+            m_interrupted.store(true);
+        }
+        m_wakeUp.notify_one();
+    }
+
+private:
+    struct Timer
+    {
+        int id;
+        qint64 interval;
+        Qt::TimerType type;
+        QObject *object;
+        qint64 deadline;
+    };
+
+    /*
+     * advances clock to the earliest deadline and fires one of the timers due by then,
+     * single timer per pass, so everything it posts is processed before the next one
+     */
+    bool fireNextTimer()
+    {
+        if (m_timers.isEmpty()) {
+            return false;
+        }
+
+        qint64 earliest = m_timers.first().deadline;
+        for (const Timer &timer : m_timers) {
+            earliest = qMin(earliest, timer.deadline);
+        }
+        QList<qsizetype> due;
+        for (qsizetype i = 0; i < m_timers.size(); ++i) {
+            if (m_timers[i].deadline == earliest) {
+                due.append(i);
+            }
+        }
+
+        Timer &timer = m_timers[due[m_random.bounded(int(due.size()))]];
+        m_now = qMax(m_now, earliest);
+        // rearmed before event is sent — handler may kill it (or delete the object)
+        // zero interval timers still move the clock, otherwise they'd freeze it
+        timer.deadline = m_now + jittered(qMax<qint64>(timer.interval, 1));
+
+        QTimerEvent event(timer.id);
+        QCoreApplication::sendEvent(timer.object, &event);
+        return true;
+    }
+
+    QRandomGenerator m_random;
+    const int m_jitterPercent;
+    qint64 m_now = 0;
+    QList<Timer> m_timers;
+
+    // set from any thread
+    std::mutex m_mutex;
+    std::condition_variable m_wakeUp;
+    std::atomic<bool> m_woken = false;
+    std::atomic<bool> m_interrupted = false;
+};
+
+// =============================================================================
+
+struct VirtualTime
+{
+    static bool enabled()
+    {
+        return VirtualTimeDispatcher::current() != nullptr;
+    }
+
+    /*
+     * QThread::sleep() in real time, under virtual time only adds up to how long
+     * `run()` task takes
+     */
+    static void sleep(std::chrono::milliseconds duration)
+    {
+        if (enabled()) {
+            slept() += duration.count();
+            return;
+        }
+        QThread::msleep(duration.count());
+    }
+
+    /*
+     * QtConcurrent::run() in real time, under virtual time — simulated future
+     */
+    template<typename Function, typename... Args>
+    static auto run(Function &&function, Args &&...args)
+    {
+        VirtualTimeDispatcher *dispatcher = VirtualTimeDispatcher::current();
+        if (!dispatcher) {
+            return QtConcurrent::run(std::forward<Function>(function), std::forward<Args>(args)...);
+        }
+
+        using T = std::invoke_result_t<std::decay_t<Function>, std::decay_t<Args>...>;
+        // QPromise is move-only, QTimer wants copyable functor
+        auto promise = std::make_shared<QPromise<T>>();
+        promise->start();
+        QFuture<T> future = promise->future();
+
+        slept() = 0;
+        if constexpr (std::is_void_v<T>) {
+            std::invoke(std::forward<Function>(function), std::forward<Args>(args)...);
+        } else {
+            promise->addResult(std::invoke(std::forward<Function>(function), std::forward<Args>(args)...));
+        }
+
+        QTimer::singleShot(int(dispatcher->jittered(slept())), Qt::PreciseTimer, dispatcher, [promise] {
+            promise->finish();
+        });
+        return future;
+    }
+
+private:
+    static qint64 &slept()
+    {
+        static thread_local qint64 value = 0;
+        return value;
+    }
+};
@@ -0,0 +1,382 @@
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QPromise>
+#include <QRandomGenerator>
+#include <QDebug>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include <sys/resource.h>
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+#define SOAK_MALLINFO 1
+#include <malloc.h>
+#endif
+
+#include "qcosignal.hpp"
+
+/*
+ * soak test — keeps lots of coroutines suspended at once (on signals, futures and
+ * chains of other coroutines), randomly destroys their owners and senders, wakes up
+ * the rest and checks that every frame and every byte is given back afterwards
+ *
+ *   qcosignal_soak [coroutines = 1000000] [rounds = 3] [seed = 1]
+ *
+ * first round warms up Qt's internal caches (event queues, connection lists, etc.),
+ * every next one must return heap to the level left by the first one
+ * exits with 1 on leaked frames, hung coroutines or heap growth
+ */
+
+// =============================================================================
+
+/*
+ * counting allocator hook — all `new`-s in the process are accounted here,
+ * coroutine frames included (those are also counted separately by COSIGNAL_FRAME_STATS)
+ */
+namespace
+{
+std::atomic<qint64> g_heapBytes = 0;
+std::atomic<qint64> g_allocations = 0;
+
+// block size is stashed in front of the block, keeping fundamental alignment
+constexpr std::size_t Header = alignof(std::max_align_t);
+
+void *countedAlloc(std::size_t size) noexcept
+{
+    char *block = static_cast<char*>(std::malloc(size + Header));
+    if (!block) {
+        return nullptr;
+    }
+    *reinterpret_cast<std::size_t*>(block) = size;
+    g_heapBytes.fetch_add(size, std::memory_order_relaxed);
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return block + Header;
+}
+
+void countedFree(void *pointer) noexcept
+{
+    if (!pointer) {
+        return;
+    }
+    char *block = static_cast<char*>(pointer) - Header;
+    g_heapBytes.fetch_sub(*reinterpret_cast<std::size_t*>(block), std::memory_order_relaxed);
+    std::free(block);
+}
+}
+
+void *operator new(std::size_t size)
+{
+    if (void *pointer = countedAlloc(size)) {
+        return pointer;
+    }
+#ifdef __cpp_exceptions
+    throw std::bad_alloc();
+#else
+    std::abort();
+#endif
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    return countedAlloc(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    return countedAlloc(size);
+}
+
+void operator delete(void *pointer) noexcept { countedFree(pointer); }
+void operator delete[](void *pointer) noexcept { countedFree(pointer); }
+void operator delete(void *pointer, std::size_t) noexcept { countedFree(pointer); }
+void operator delete[](void *pointer, std::size_t) noexcept { countedFree(pointer); }
+void operator delete(void *pointer, const std::nothrow_t &) noexcept { countedFree(pointer); }
+void operator delete[](void *pointer, const std::nothrow_t &) noexcept { countedFree(pointer); }
+
+// =============================================================================
+
+namespace
+{
+// coroutines currently alive (suspended, since there is only one thread)
+qint64 g_suspended = 0;
+qint64 g_completed = 0;
+
+/*
+ * lives in every soak coroutine frame, so aborted coroutines are accounted too
+ */
+struct Suspended
+{
+    Suspended() { ++g_suspended; }
+    ~Suspended() { --g_suspended; }
+};
+
+// malloc() made by Qt containers bypasses `operator new`, so asking libc too
+qint64 mallocBytes()
+{
+#ifdef SOAK_MALLINFO
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+qint64 peakRssKiB()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+/*
+ * runs event loop until nothing is happening anymore:
+ * future continuations and deferred deletes are delivered via posted events
+ */
+void drain()
+{
+    qint64 previous = -1;
+    int quiet = 0;
+    while (quiet < 2) {
+        QCoreApplication::processEvents(QEventLoop::AllEvents);
+        QCoreApplication::sendPostedEvents(nullptr, QEvent::DeferredDelete);
+        quiet = (previous == g_suspended) ? quiet + 1 : 0;
+        previous = g_suspended;
+    }
+}
+}
+
+// =============================================================================
+
+class SoakObject : public QObject
+{
+    Q_OBJECT
+public:
+    Async<> awaitSignal(SoakObject *sender);
+    Async<> awaitFuture(QFuture<int> future);
+    Async<int> chain(const std::vector<SoakObject*> *owners, QRandomGenerator *random, int depth, SoakObject *sender);
+    Async<> awaitChain(const std::vector<SoakObject*> *owners, QRandomGenerator *random, SoakObject *sender);
+
+signals:
+    void fire();
+};
+
+Async<> SoakObject::awaitSignal(SoakObject *sender)
+{
+    Suspended s;
+    co_await CoSignal(sender, &SoakObject::fire);
+    ++g_completed;
+}
+
+Async<> SoakObject::awaitFuture(QFuture<int> future)
+{
+    Suspended s;
+    co_await future;
+    ++g_completed;
+}
+
+Async<int> SoakObject::chain(const std::vector<SoakObject*> *owners, QRandomGenerator *random, int depth, SoakObject *sender)
+{
+    Suspended s;
+    if (depth == 0) {
+        co_await CoSignal(sender, &SoakObject::fire);
+        ++g_completed;
+        co_return 1;
+    }
+
+    // every link of the chain is bound to a random owner
+    SoakObject *next = owners->at(random->bounded(qint64(owners->size())));
+    int links = co_await next->chain(owners, random, depth - 1, sender);
+    ++g_completed;
+    co_return links + 1;
+}
+
+Async<> SoakObject::awaitChain(const std::vector<SoakObject*> *owners, QRandomGenerator *random, SoakObject *sender)
+{
+    Suspended s;
+    co_await chain(owners, random, 2, sender);
+    ++g_completed;
+}
+
+// =============================================================================
+
+struct RoundReport
+{
+    qint64 suspended = 0;
+    qint64 hung = 0;
+    qint64 leakedFrames = 0;
+    qint64 heapBytes = 0;
+    qint64 mallocBytes = 0;
+};
+
+static RoundReport soakRound(qsizetype count, QRandomGenerator &random)
+{
+    RoundReport report;
+    QElapsedTimer timer;
+
+    // ~64 coroutines per owner and per sender, ~1024 per future
+    const qsizetype objects = qMax<qsizetype>(count / 64, 1);
+    const qsizetype futures = qMax<qsizetype>(count / 1024, 1);
+
+    std::vector<SoakObject*> owners;
+    std::vector<SoakObject*> senders;
+    std::vector<QPromise<int>> promises(futures);
+    std::vector<QFuture<int>> pending;
+    owners.reserve(objects);
+    senders.reserve(objects);
+    pending.reserve(futures);
+    for (qsizetype i = 0; i < objects; ++i) {
+        owners.push_back(new SoakObject);
+        senders.push_back(new SoakObject);
+    }
+    for (QPromise<int> &promise : promises) {
+        promise.start();
+        pending.push_back(promise.future());
+    }
+
+    const qint64 heapBefore = g_heapBytes.load();
+    const qint64 allocationsBefore = g_allocations.load();
+
+    /*
+     * spawning: 40% on signals, 30% on futures, 30% in chains four coroutines deep
+     */
+    timer.start();
+    while (g_suspended < count) {
+        SoakObject *owner = owners[random.bounded(qint64(owners.size()))];
+        SoakObject *sender = senders[random.bounded(qint64(senders.size()))];
+        const quint32 kind = random.bounded(10);
+        if (kind < 4) {
+            owner->awaitSignal(sender);
+        } else if (kind < 7) {
+            owner->awaitFuture(pending[random.bounded(qint64(pending.size()))]);
+        } else {
+            owner->awaitChain(&owners, &random, sender);
+        }
+    }
+    report.suspended = g_suspended;
+    const qint64 spawnAllocations = g_allocations.load() - allocationsBefore;
+    qInfo().noquote() << QString("  spawned %1 coroutines in %2 ms: %3 bytes and %4 allocations per suspended coroutine, %5 bytes per frame")
+        .arg(report.suspended)
+        .arg(timer.elapsed())
+        .arg(double(g_heapBytes.load() - heapBefore) / report.suspended, 0, 'f', 1)
+        .arg(double(spawnAllocations) / report.suspended, 0, 'f', 2)
+        .arg(double(CoroutineFrameStats::liveBytes.load()) / CoroutineFrameStats::live.load(), 0, 'f', 1);
+
+    /*
+     * churn: destroying random tenth of owners and senders, aborting everything
+     * bound to or awaiting on them, then waking up all the survivors
+     */
+    timer.restart();
+    const qint64 allocationsBeforeChurn = g_allocations.load();
+    const qint64 suspendedBeforeChurn = g_suspended;
+    const qint64 completedBeforeChurn = g_completed;
+
+    for (std::vector<SoakObject*> *pool : {&senders, &owners}) {
+        for (qsizetype i = 0; i < objects / 10; ++i) {
+            qint64 victim = random.bounded(qint64(pool->size()));
+            delete pool->at(victim);
+            pool->at(victim) = pool->back();
+            pool->pop_back();
+            // chains pick owners from `owners`, but nothing is spawned anymore
+            if (pool->empty()) {
+                break;
+            }
+        }
+    }
+    const qint64 aborted = suspendedBeforeChurn - g_suspended;
+
+    for (SoakObject *sender : senders) {
+        emit sender->fire();
+    }
+    for (qsizetype i = 0; i < futures; ++i) {
+        promises[i].addResult(int(i));
+        promises[i].finish();
+    }
+    drain();
+
+    const qint64 operations = aborted + (g_completed - completedBeforeChurn);
+    qInfo().noquote() << QString("  aborted %1 and resumed %2 coroutines in %3 ms: %4 allocations per operation")
+        .arg(aborted)
+        .arg(g_completed - completedBeforeChurn)
+        .arg(timer.elapsed())
+        .arg(double(g_allocations.load() - allocationsBeforeChurn) / qMax<qint64>(operations, 1), 0, 'f', 2);
+
+    // everything was either aborted or resumed, nothing should be left waiting
+    report.hung = g_suspended;
+
+    // tearing down the rest, hung coroutines (if any) go with their owners
+    for (SoakObject *object : owners) {
+        delete object;
+    }
+    for (SoakObject *object : senders) {
+        delete object;
+    }
+    owners.clear();
+    senders.clear();
+    pending.clear();
+    promises.clear();
+    drain();
+
+    report.leakedFrames = CoroutineFrameStats::live.load();
+    report.heapBytes = g_heapBytes.load();
+    report.mallocBytes = mallocBytes();
+    return report;
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    const qsizetype count = argc > 1 ? QByteArray(argv[1]).toLongLong() : 1000000;
+    const int rounds = argc > 2 ? QByteArray(argv[2]).toInt() : 3;
+    const quint32 seed = argc > 3 ? QByteArray(argv[3]).toUInt() : 1;
+
+    QRandomGenerator random(seed);
+
+    // heap growth tolerated after warm-up round, well below a byte per coroutine
+    const qint64 tolerance = 64 * 1024;
+
+    qint64 heapBaseline = 0;
+    qint64 mallocBaseline = 0;
+    bool failed = false;
+
+    for (int round = 1; round <= rounds; ++round) {
+        qInfo().noquote() << QString("round %1 of %2").arg(round).arg(rounds);
+        const RoundReport report = soakRound(count, random);
+
+        if (round == 1) {
+            heapBaseline = report.heapBytes;
+            mallocBaseline = report.mallocBytes;
+        }
+
+        qInfo().noquote() << QString("  peak RSS %1 MiB, heap %2 bytes (%3 after first round), leaked frames %4, hung coroutines %5")
+            .arg(peakRssKiB() / 1024)
+            .arg(report.heapBytes)
+            .arg(report.heapBytes - heapBaseline)
+            .arg(report.leakedFrames)
+            .arg(report.hung);
+
+        if (report.leakedFrames != 0 || report.hung != 0) {
+            failed = true;
+        }
+        if (report.heapBytes - heapBaseline > tolerance || report.mallocBytes - mallocBaseline > tolerance) {
+            qCritical().noquote() << QString("  memory didn't return to baseline: heap +%1, malloc +%2 bytes")
+                .arg(report.heapBytes - heapBaseline)
+                .arg(report.mallocBytes - mallocBaseline);
+            failed = true;
+        }
+    }
+
+    qInfo() << (failed ? "FAILED" : "OK");
+    return failed ? 1 : 0;
+}
+
+#include "soak.moc"